@@ -0,0 +1,449 @@
+/* buffer_cache.c: Write-back cache of file system sectors.
+
+   Every sector that inode.c reads or writes goes through a fixed set
+   of BUFFER_CACHE_SIZE entries, found by sector number through a hash
+   table.  A write only dirties the cached copy; the sector goes to
+   disk when its entry is reused for another sector or when
+   buffer_cache_flush() runs.  The "flusher" kernel thread calls it
+   every FLUSH_INTERVAL, and so do fsync() and filesys_done().  It
+   writes the dirty sectors back in order, each run of consecutive
+   sectors in a single disk transfer.
+
+   Entries are replaced with the clock algorithm.  The hand sweeps the
+   entries, clearing the accessed bit of each entry it passes, and
+   stops at the first one that was not accessed since the previous
+   sweep.  Entries in use by some thread are never replaced.
+
+   CACHE_LOCK protects the hash table, the clock hand and the use
+   counts, and is held across the disk I/O of a miss, so a sector can
+   never be read while its old contents are still being written back.
+   Each entry's own lock protects its data and dirty bit, so threads
+   copying in and out of different cached sectors do not wait for each
+   other.  A thread never waits for CACHE_LOCK while it holds an entry's
+   lock.
+
+   Reads that look sequential ask for the sectors after them with
+   buffer_cache_readahead().  The request is queued for the
+   "readahead" kernel thread, which loads the sectors that are not
+   cached yet while the reader goes on with the data it already has.
+   Queued requests are only hints: they are dropped when the queue is
+   full, and the thread never waits for an entry to become free. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors the buffer cache holds, by default. */
+#define BUFFER_CACHE_SIZE 64
+
+/* Readahead requests that may be queued at once. */
+#define READAHEAD_QUEUE_SIZE 16
+
+/* Timer ticks between two write-backs by the flusher thread. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Most sectors written back in one transfer. */
+#define FLUSH_RUN_MAX 64
+
+size_t buffer_cache_size = BUFFER_CACHE_SIZE;
+
+/* A cached sector. */
+struct cache_entry {
+	struct hash_elem elem;              /* Element in the cache's table. */
+	disk_sector_t sector;               /* Sector held, if VALID. */
+	bool valid;                         /* Holds a sector? */
+	bool accessed;                      /* Used since the hand passed? */
+	bool prefetched;                    /* Read ahead and not used yet? */
+	unsigned users;                     /* Threads using the entry. */
+
+	struct lock lock;                   /* Protects the members below. */
+	bool dirty;                         /* Newer than the disk? */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+};
+
+static struct cache_entry *entries;
+static struct hash cache;
+static size_t hand;
+
+/* Protects CACHE, HAND and each entry's SECTOR, VALID, ACCESSED and
+ * USERS. */
+static struct lock cache_lock;
+/* Signaled when an entry's USERS drops to zero. */
+static struct condition cache_idle;
+
+/* A run of sectors to read ahead. */
+struct readahead_req {
+	disk_sector_t sector;               /* First sector. */
+	size_t cnt;                         /* Number of sectors. */
+};
+
+/* Queue of readahead requests, a ring buffer. */
+static struct readahead_req ra_queue[READAHEAD_QUEUE_SIZE];
+static size_t ra_head;                  /* Next request to serve. */
+static size_t ra_cnt;                   /* Requests queued. */
+/* Protects the queue. */
+static struct lock ra_lock;
+/* Signaled when a request is queued. */
+static struct condition ra_ready;
+
+/* Serializes buffer_cache_flush(). */
+static struct lock flush_lock;
+/* Entries being written back by buffer_cache_flush(). */
+static struct cache_entry **flush_batch;
+
+/* Statistics. */
+static long long hit_cnt;
+static long long miss_cnt;
+static long long writeback_cnt;
+static long long transfer_cnt;          /* Disk writes of the above. */
+static long long ra_read_cnt;           /* Sectors read ahead. */
+static long long ra_hit_cnt;            /* Of those, sectors used later. */
+
+static void readaheadd (void *aux);
+static void flusher (void *aux);
+
+/* Returns a hash value for entry E. */
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct cache_entry *ce = hash_entry (e, struct cache_entry, elem);
+	return hash_bytes (&ce->sector, sizeof ce->sector);
+}
+
+/* Returns true if entry A's sector precedes B's. */
+static bool
+cache_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct cache_entry, elem)->sector
+		< hash_entry (b, struct cache_entry, elem)->sector;
+}
+
+/* Initializes the buffer cache. */
+void
+buffer_cache_init (void) {
+	size_t i;
+
+	if (buffer_cache_size == 0)
+		buffer_cache_size = 1;
+	entries = calloc (buffer_cache_size, sizeof *entries);
+	flush_batch = calloc (buffer_cache_size, sizeof *flush_batch);
+	if (entries == NULL || flush_batch == NULL)
+		PANIC ("could not allocate %zu-sector buffer cache",
+				buffer_cache_size);
+	for (i = 0; i < buffer_cache_size; i++)
+		lock_init (&entries[i].lock);
+
+	hash_init (&cache, cache_hash, cache_less, NULL);
+	lock_init (&cache_lock);
+	cond_init (&cache_idle);
+
+	lock_init (&flush_lock);
+
+	lock_init (&ra_lock);
+	cond_init (&ra_ready);
+	thread_create ("readahead", PRI_DEFAULT, readaheadd, NULL);
+	thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+}
+
+/* Returns the entry holding SECTOR, or NULL. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector) {
+	struct cache_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&cache, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Chooses an entry to reuse with the clock algorithm.  Returns NULL if
+ * every entry is in use. */
+static struct cache_entry *
+cache_victim (void) {
+	size_t i;
+
+	/* Two sweeps: the first may only clear accessed bits. */
+	for (i = 0; i < 2 * buffer_cache_size; i++) {
+		struct cache_entry *e = &entries[hand];
+
+		hand = (hand + 1) % buffer_cache_size;
+		if (e->users > 0)
+			continue;
+		if (!e->valid || !e->accessed)
+			return e;
+		e->accessed = false;
+	}
+	return NULL;
+}
+
+/* Makes an unused entry hold SECTOR, writing its old sector back
+ * first if it is dirty, and returns it.  The sector is read from disk
+ * unless FILL is false.  If every entry is in use, waits for one to
+ * become free if WAIT is true or returns NULL otherwise; if SECTOR is
+ * loaded by another thread while waiting, returns its entry instead.
+ * Must be called with CACHE_LOCK held. */
+static struct cache_entry *
+cache_load (disk_sector_t sector, bool fill, bool wait) {
+	struct cache_entry *e;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	while ((e = cache_victim ()) == NULL) {
+		if (!wait)
+			return NULL;
+		cond_wait (&cache_idle, &cache_lock);
+
+		/* Another thread may have loaded SECTOR meanwhile. */
+		e = cache_lookup (sector);
+		if (e != NULL)
+			return e;
+	}
+
+	/* Nobody uses E, so its lock is free and its fields are ours. */
+	if (e->valid) {
+		if (e->dirty) {
+			disk_write (filesys_disk, e->sector, e->data);
+			writeback_cnt++;
+			transfer_cnt++;
+		}
+		hash_delete (&cache, &e->elem);
+	}
+	e->sector = sector;
+	e->valid = true;
+	e->dirty = false;
+	e->prefetched = false;
+	hash_insert (&cache, &e->elem);
+	if (fill)
+		disk_read (filesys_disk, sector, e->data);
+	return e;
+}
+
+/* Returns the entry for SECTOR, locked, reusing another entry on a
+ * miss.  The sector is read from disk unless FILL is false, in which
+ * case the caller must overwrite the whole sector. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool fill) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	e = cache_lookup (sector);
+	if (e != NULL) {
+		hit_cnt++;
+		if (e->prefetched) {
+			e->prefetched = false;
+			ra_hit_cnt++;
+		}
+	} else {
+		miss_cnt++;
+		e = cache_load (sector, fill, true);
+	}
+	e->accessed = true;
+	e->users++;
+	lock_release (&cache_lock);
+
+	lock_acquire (&e->lock);
+	return e;
+}
+
+/* Unlocks entry E, obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e) {
+	lock_release (&e->lock);
+
+	lock_acquire (&cache_lock);
+	if (--e->users == 0)
+		cond_signal (&cache_idle, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, size < DISK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	e->dirty = true;
+	cache_put (e);
+}
+
+/* Orders pointers to entries by sector, for qsort(). */
+static int
+compare_sector (const void *a_, const void *b_) {
+	const struct cache_entry *a = *(struct cache_entry *const *) a_;
+	const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+	return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes the CNT entries in BATCH, which hold consecutive sectors
+ * starting at BATCH[0]'s, back to disk in one transfer. */
+static void
+flush_run (struct cache_entry **batch, size_t cnt) {
+	const void *buffers[FLUSH_RUN_MAX];
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		lock_acquire (&batch[i]->lock);
+		buffers[i] = batch[i]->data;
+	}
+	disk_write_multiple (filesys_disk, batch[0]->sector, cnt, buffers);
+	for (i = 0; i < cnt; i++) {
+		batch[i]->dirty = false;
+		lock_release (&batch[i]->lock);
+	}
+}
+
+/* Writes every dirty sector back to disk. */
+void
+buffer_cache_flush (void) {
+	size_t cnt = 0, run_cnt = 0;
+	size_t i, j;
+
+	if (entries == NULL)
+		return;
+
+	lock_acquire (&flush_lock);
+
+	/* Keep the dirty entries from being reused while we write them.
+	 * An entry that is being dirtied right now may be missed; it
+	 * will be written by the next flush. */
+	lock_acquire (&cache_lock);
+	for (i = 0; i < buffer_cache_size; i++) {
+		struct cache_entry *e = &entries[i];
+
+		if (e->valid && e->dirty) {
+			e->users++;
+			flush_batch[cnt++] = e;
+		}
+	}
+	lock_release (&cache_lock);
+
+	/* Only this function cleans a dirty entry in use, so every entry
+	 * of the batch stays dirty until we get to it. */
+	qsort (flush_batch, cnt, sizeof *flush_batch, compare_sector);
+	for (i = 0; i < cnt; i = j) {
+		for (j = i + 1; j < cnt && j - i < FLUSH_RUN_MAX; j++)
+			if (flush_batch[j]->sector != flush_batch[i]->sector + (j - i))
+				break;
+		flush_run (flush_batch + i, j - i);
+		run_cnt++;
+	}
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < cnt; i++)
+		flush_batch[i]->users--;
+	if (cnt > 0)
+		cond_broadcast (&cache_idle, &cache_lock);
+	writeback_cnt += cnt;
+	transfer_cnt += run_cnt;
+	lock_release (&cache_lock);
+
+	lock_release (&flush_lock);
+}
+
+/* The flusher thread. */
+static void
+flusher (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_INTERVAL);
+		buffer_cache_flush ();
+	}
+}
+
+/* Asks for the CNT sectors starting at SECTOR to be read into the
+ * cache in the background. */
+void
+buffer_cache_readahead (disk_sector_t sector, size_t cnt) {
+	/* Leave most of the cache to data that is in use. */
+	if (cnt > buffer_cache_size / 4)
+		cnt = buffer_cache_size / 4;
+	if (cnt == 0)
+		return;
+
+	lock_acquire (&ra_lock);
+	if (ra_cnt < READAHEAD_QUEUE_SIZE) {
+		ra_queue[(ra_head + ra_cnt++) % READAHEAD_QUEUE_SIZE] =
+			(struct readahead_req) {
+				.sector = sector,
+				.cnt = cnt,
+			};
+		cond_signal (&ra_ready, &ra_lock);
+	}
+	lock_release (&ra_lock);
+}
+
+/* Reads SECTOR into the cache, unless it is there already or no entry
+ * is free. */
+static void
+cache_prefetch (disk_sector_t sector) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	if (cache_lookup (sector) == NULL) {
+		e = cache_load (sector, true, false);
+		if (e != NULL) {
+			e->accessed = true;
+			e->prefetched = true;
+			ra_read_cnt++;
+		}
+	}
+	lock_release (&cache_lock);
+}
+
+/* The readahead thread. */
+static void
+readaheadd (void *aux UNUSED) {
+	for (;;) {
+		struct readahead_req req;
+		size_t i;
+
+		lock_acquire (&ra_lock);
+		while (ra_cnt == 0)
+			cond_wait (&ra_ready, &ra_lock);
+		req = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % READAHEAD_QUEUE_SIZE;
+		ra_cnt--;
+		lock_release (&ra_lock);
+
+		/* One sector at a time, so that demand misses get in between. */
+		for (i = 0; i < req.cnt; i++)
+			cache_prefetch (req.sector + i);
+	}
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	long long total = hit_cnt + miss_cnt;
+
+	printf ("Buffer cache: %lld hits, %lld misses (%lld%% hit rate), "
+			"%lld write-backs in %lld transfers\n", hit_cnt, miss_cnt,
+			total != 0 ? hit_cnt * 100 / total : 0, writeback_cnt,
+			transfer_cnt);
+	printf ("Readahead: %lld sectors read, %lld used\n",
+			ra_read_cnt, ra_hit_cnt);
+}
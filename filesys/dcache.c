@@ -0,0 +1,222 @@
+/* dcache.c: Cache of directory lookups.
+
+   Maps a directory's inode sector and a name in it to the inode
+   sector the name refers to, so that opening the same path again
+   does not search the directory.  A name that was looked up and not
+   found is cached too, as a "negative" entry with sector 0, which
+   never holds an inode.
+
+   directory.c keeps the cache in step: dir_add() and dir_remove()
+   replace the entry for the name they change, and dir_create()
+   drops every entry under a directory sector being reused.  At most
+   DCACHE_SIZE entries are kept; the least recently used one makes
+   room for a new one.
+
+   A lookup that misses searches the directory without a lock, so a
+   change may land between the search and the caching of its result.
+   Each change bumps a generation number of its directory, and the
+   result is cached only if the name is still missing and the
+   generation has not moved since the miss.  Directories share
+   DCACHE_GEN_CNT generation numbers, which costs an occasional
+   result that is not cached but never a stale one. */
+
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Most entries kept. */
+#define DCACHE_SIZE 256
+
+/* Generation numbers, shared by directories with the same sector
+ * modulo this. */
+#define DCACHE_GEN_CNT 64
+
+/* A cached lookup. */
+struct dentry {
+	struct hash_elem elem;              /* Element in DENTRIES. */
+	struct list_elem lru_elem;          /* Element in LRU. */
+	disk_sector_t dir;                  /* Directory's inode sector. */
+	char name[NAME_MAX + 1];            /* Name within DIR. */
+	disk_sector_t sector;               /* Its inode sector, or 0. */
+};
+
+static struct hash dentries;
+/* Entries, most recently used first. */
+static struct list lru;
+static struct slab_cache dentry_slab;
+/* Changes to directories, by directory sector. */
+static unsigned generations[DCACHE_GEN_CNT];
+/* Protects the members above and the statistics. */
+static struct lock dcache_lock;
+
+/* Statistics. */
+static long long hit_cnt;
+static long long negative_hit_cnt;
+static long long miss_cnt;
+
+/* Returns a hash value for dentry E. */
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, elem);
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, elem);
+
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the directory lookup cache. */
+void
+dcache_init (void) {
+	hash_init (&dentries, dentry_hash, dentry_less, NULL);
+	list_init (&lru);
+	slab_cache_init (&dentry_slab, "dentry", sizeof (struct dentry), NULL);
+	lock_init (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or NULL.  Must be called with
+ * DCACHE_LOCK held. */
+static struct dentry *
+dentry_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dentries, &key.elem);
+	return e != NULL ? hash_entry (e, struct dentry, elem) : NULL;
+}
+
+/* Removes entry D and frees it.  Must be called with DCACHE_LOCK
+ * held. */
+static void
+dentry_free (struct dentry *d) {
+	hash_delete (&dentries, &d->elem);
+	list_remove (&d->lru_elem);
+	slab_free (&dentry_slab, d);
+}
+
+/* Returns a pointer to the generation number of directory DIR.  Must
+ * be called with DCACHE_LOCK held. */
+static unsigned *
+generation (disk_sector_t dir) {
+	return &generations[dir % DCACHE_GEN_CNT];
+}
+
+/* Looks NAME in directory DIR up in the cache.  If it is there,
+ * stores the sector NAME refers to into *SECTORP, or 0 if NAME is
+ * known not to exist, and returns true.  Returns false otherwise,
+ * with DIR's generation number in *GENP for dcache_fill(). */
+bool
+dcache_lookup (disk_sector_t dir, const char *name, disk_sector_t *sectorp,
+		unsigned *genp) {
+	struct dentry *d;
+
+	*genp = 0;
+	if (strlen (name) > NAME_MAX)
+		return false;
+
+	lock_acquire (&dcache_lock);
+	*genp = *generation (dir);
+	d = dentry_find (dir, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_front (&lru, &d->lru_elem);
+		*sectorp = d->sector;
+		if (d->sector != 0)
+			hit_cnt++;
+		else
+			negative_hit_cnt++;
+	} else
+		miss_cnt++;
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Makes the entry for NAME in directory DIR refer to SECTOR,
+ * creating it if necessary.  Must be called with DCACHE_LOCK held. */
+static void
+dentry_set (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	struct dentry *d = dentry_find (dir, name);
+
+	if (d == NULL) {
+		if (hash_size (&dentries) >= DCACHE_SIZE)
+			dentry_free (list_entry (list_back (&lru), struct dentry,
+						lru_elem));
+		d = slab_alloc (&dentry_slab);
+		if (d == NULL)
+			return;
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dentries, &d->elem);
+	} else
+		list_remove (&d->lru_elem);
+	d->sector = sector;
+	list_push_front (&lru, &d->lru_elem);
+}
+
+/* Records that NAME in directory DIR now refers to the inode in
+ * SECTOR, or that it no longer exists if SECTOR is 0. */
+void
+dcache_insert (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	(*generation (dir))++;
+	dentry_set (dir, name, sector);
+	lock_release (&dcache_lock);
+}
+
+/* Caches SECTOR, found by searching directory DIR for NAME after
+ * dcache_lookup() missed and returned GEN, unless DIR may have changed
+ * since. */
+void
+dcache_fill (disk_sector_t dir, const char *name, disk_sector_t sector,
+		unsigned gen) {
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	if (*generation (dir) == gen && dentry_find (dir, name) == NULL)
+		dentry_set (dir, name, sector);
+	lock_release (&dcache_lock);
+}
+
+/* Drops every entry for names in directory DIR. */
+void
+dcache_purge_dir (disk_sector_t dir) {
+	struct list_elem *e, *next;
+
+	lock_acquire (&dcache_lock);
+	(*generation (dir))++;
+	for (e = list_begin (&lru); e != list_end (&lru); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+
+		next = list_next (e);
+		if (d->dir == dir)
+			dentry_free (d);
+	}
+	lock_release (&dcache_lock);
+}
+
+/* Prints directory lookup cache statistics. */
+void
+dcache_print_stats (void) {
+	printf ("Dcache: %lld hits, %lld negative hits, %lld misses\n",
+			hit_cnt, negative_hit_cnt, miss_cnt);
+}
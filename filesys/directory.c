@@ -1,11 +1,40 @@
 #include "filesys/directory.h"
+#include <hash.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#endif
 #include "threads/malloc.h"
 
+/* A directory is stored as a hash table of entries with open
+ * addressing.  The first entry-sized slot of the file holds a
+ * header, and slot I of the table follows at DIR_SLOT_OFS (I).  A
+ * name lives in the first slot at or after its hash, counting modulo
+ * SLOT_CNT, that is not taken by another name.  So a lookup reads
+ * slots from the name's hash on and stops at the name or at a slot
+ * that was never used, and with the table kept at most 3/4 full it
+ * reads about two of them, all through the buffer cache.  Removing a
+ * name leaves a "deleted" slot behind, so that the lookups of names
+ * stored past it do not stop early.  When used and deleted slots
+ * fill the table, it is rebuilt without the deleted slots, twice as
+ * large if necessary.  The rebuilt table is put together in memory
+ * and written out before the header points to it.
+ *
+ * Directory handles for one directory share its inode, so lookups
+ * that miss the dentry cache, additions and removals hold the
+ * inode's directory lock while they read and change the table. */
+
+/* Identifies a directory header. */
+#define DIR_MAGIC 0x44495248
+
+/* Slots in the smallest table. */
+#define DIR_MIN_SLOTS 16
+
 /* A directory. */
 struct dir {
 	struct inode *inode;                /* Backing store. */
@@ -17,13 +46,163 @@ struct dir_entry {
 	disk_sector_t inode_sector;         /* Sector number of header. */
 	char name[NAME_MAX + 1];            /* Null terminated file name. */
 	bool in_use;                        /* In use or free? */
+	bool deleted;                       /* Free, but was in use? */
+};
+
+/* Directory header, in the first slot. */
+struct dir_header {
+	unsigned magic;                     /* DIR_MAGIC. */
+	uint32_t slot_cnt;                  /* Slots in the table. */
+	uint32_t entry_cnt;                 /* Slots in use. */
+	uint32_t deleted_cnt;               /* Deleted slots. */
 };
 
+/* Byte offset of slot IDX in a directory. */
+#define DIR_SLOT_OFS(IDX) ((off_t) (((IDX) + 1) * sizeof (struct dir_entry)))
+
+/* Reads DIR's header into *H.  Returns false if it is unreadable. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) {
+	return inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+		&& h->magic == DIR_MAGIC && h->slot_cnt > 0;
+}
+
+/* Writes header H to DIR.  Returns true if successful. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h) {
+	return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns the slot where the search for NAME starts, in a table of
+ * SLOT_CNT slots. */
+static size_t
+home_slot (const char *name, size_t slot_cnt) {
+	return hash_string (name) % slot_cnt;
+}
+
+/* Searches the table of DIR, which has header H, for NAME.  Returns
+ * the offset of its entry and copies the entry into *EP if EP is
+ * non-null.  Otherwise returns -1 and sets *FREEP, if FREEP is
+ * non-null, to the offset of the slot NAME would be added to, or to
+ * -1 if the table is full. */
+static off_t
+probe (const struct dir *dir, const struct dir_header *h, const char *name,
+		struct dir_entry *ep, off_t *freep) {
+	size_t idx = home_slot (name, h->slot_cnt);
+	off_t free_ofs = -1;
+	size_t i;
+
+	for (i = 0; i < h->slot_cnt; i++, idx = (idx + 1) % h->slot_cnt) {
+		off_t ofs = DIR_SLOT_OFS (idx);
+		struct dir_entry e;
+
+		if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+			break;
+		if (e.in_use) {
+			if (!strcmp (name, e.name)) {
+				if (ep != NULL)
+					*ep = e;
+				return ofs;
+			}
+		} else {
+			if (free_ofs == -1)
+				free_ofs = ofs;
+			if (!e.deleted)
+				break;
+		}
+	}
+	if (freep != NULL)
+		*freep = free_ofs;
+	return -1;
+}
+
+/* Rebuilds the table of DIR, whose header is *H, with SLOT_CNT slots
+ * and no deleted ones.  SLOT_CNT must not be smaller than the old
+ * slot count.  Returns true if successful; on failure the old table
+ * is left as it was. */
+static bool
+resize (struct dir *dir, struct dir_header *h, size_t slot_cnt) {
+	size_t old_cnt = h->slot_cnt;
+	off_t old_size = old_cnt * sizeof (struct dir_entry);
+	off_t tail_size = (slot_cnt - old_cnt) * sizeof (struct dir_entry);
+	struct dir_header new_h = *h;
+	struct dir_entry *old, *new;
+	bool success = false;
+	size_t i;
+
+	ASSERT (slot_cnt >= old_cnt);
+
+	old = malloc (old_size);
+	new = calloc (slot_cnt, sizeof *new);
+	if (old == NULL || new == NULL)
+		goto done;
+	if (inode_read_at (dir->inode, old, old_size, DIR_SLOT_OFS (0))
+			!= old_size)
+		goto done;
+
+	/* Build the new table in memory. */
+	for (i = 0; i < old_cnt; i++) {
+		size_t idx;
+
+		if (!old[i].in_use)
+			continue;
+		idx = home_slot (old[i].name, slot_cnt);
+		while (new[idx].in_use)
+			idx = (idx + 1) % slot_cnt;
+		new[idx] = old[i];
+	}
+
+	/* Write the slots past the old table first, since only they may
+	 * need new sectors: if the disk is full, the old table is still
+	 * whole.  The old table's sectors are already allocated, so
+	 * overwriting them, and then the header, does not fail. */
+	if (inode_write_at (dir->inode, new + old_cnt, tail_size,
+				DIR_SLOT_OFS (old_cnt)) != tail_size
+			|| inode_write_at (dir->inode, new, old_size, DIR_SLOT_OFS (0))
+			!= old_size)
+		goto done;
+	new_h.slot_cnt = slot_cnt;
+	new_h.deleted_cnt = 0;
+	success = write_header (dir, &new_h);
+	if (success)
+		*h = new_h;
+
+done:
+	free (old);
+	free (new);
+	return success;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+	struct dir_header h;
+	struct dir dir;
+	size_t slot_cnt = DIR_MIN_SLOTS;
+	bool success;
+
+	ASSERT (sizeof h <= sizeof (struct dir_entry));
+
+	/* Keep the table no more than half full. */
+	while (slot_cnt < 2 * entry_cnt)
+		slot_cnt *= 2;
+	if (!inode_create (sector, DIR_SLOT_OFS (slot_cnt)))
+		return false;
+
+	/* Forget the names of any directory that used the sector before. */
+	dcache_purge_dir (sector);
+
+	dir.inode = inode_open (sector);
+	if (dir.inode == NULL)
+		return false;
+	h = (struct dir_header) {
+		.magic = DIR_MAGIC,
+		.slot_cnt = slot_cnt,
+	};
+	success = write_header (&dir, &h);
+	inode_close (dir.inode);
+	return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -46,7 +225,11 @@ dir_open (struct inode *inode) {
  * Return true if successful, false on failure. */
 struct dir *
 dir_open_root (void) {
+#ifdef EFILESYS
+	return dir_open (inode_open (cluster_to_sector (ROOT_DIR_CLUSTER)));
+#else
 	return dir_open (inode_open (ROOT_DIR_SECTOR));
+#endif
 }
 
 /* Opens and returns a new directory for the same inode as DIR.
@@ -79,22 +262,20 @@ dir_get_inode (struct dir *dir) {
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
-	struct dir_entry e;
-	size_t ofs;
+	struct dir_header h;
+	off_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL)
-				*ep = e;
-			if (ofsp != NULL)
-				*ofsp = ofs;
-			return true;
-		}
-	return false;
+	if (!read_header (dir, &h))
+		return false;
+	ofs = probe (dir, &h, name, ep, NULL);
+	if (ofs == -1)
+		return false;
+	if (ofsp != NULL)
+		*ofsp = ofs;
+	return true;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -104,15 +285,21 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t parent, sector;
 	struct dir_entry e;
+	unsigned gen;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	parent = inode_get_inumber (dir->inode);
+	if (!dcache_lookup (parent, name, &sector, &gen)) {
+		inode_lock_dir (dir->inode);
+		sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+		dcache_fill (parent, name, sector, gen);
+		inode_unlock_dir (dir->inode);
+	}
+	*inode = sector != 0 ? inode_open (sector) : NULL;
 
 	return *inode != NULL;
 }
@@ -125,9 +312,10 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_header h;
 	struct dir_entry e;
-	off_t ofs;
 	bool success = false;
+	off_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
@@ -136,29 +324,43 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
-	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
-		goto done;
+	inode_lock_dir (dir->inode);
 
-	/* Set OFS to offset of free slot.
-	 * If there are no free slots, then it will be set to the
-	 * current end-of-file.
+	/* Check that NAME is not in use, and find the slot for it. */
+	if (!read_header (dir, &h) || probe (dir, &h, name, NULL, &ofs) != -1)
+		goto done;
 
-	 * inode_read_at() will only return a short read at end of file.
-	 * Otherwise, we'd need to verify that we didn't get a short
-	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
-			break;
+	/* Make room if used and deleted slots would fill more than 3/4 of
+	 * the table, doubling it if live entries alone fill half. */
+	if (ofs == -1 || 4 * (h.entry_cnt + h.deleted_cnt + 1) > 3 * h.slot_cnt) {
+		size_t slot_cnt = h.slot_cnt;
+
+		if (2 * (h.entry_cnt + 1) > slot_cnt)
+			slot_cnt *= 2;
+		if (!resize (dir, &h, slot_cnt))
+			goto done;
+		probe (dir, &h, name, NULL, &ofs);
+		ASSERT (ofs != -1);
+	}
 
 	/* Write slot. */
+	if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+		goto done;
+	if (e.deleted)
+		h.deleted_cnt--;
+	h.entry_cnt++;
 	e.in_use = true;
+	e.deleted = false;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
-	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+			|| !write_header (dir, &h))
+		goto done;
+	dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+	success = true;
 
 done:
+	inode_unlock_dir (dir->inode);
 	return success;
 }
 
@@ -167,6 +369,7 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_header h;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -175,8 +378,13 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	inode_lock_dir (dir->inode);
+
 	/* Find directory entry. */
-	if (!lookup (dir, name, &e, &ofs))
+	if (!read_header (dir, &h))
+		goto done;
+	ofs = probe (dir, &h, name, &e, NULL);
+	if (ofs == -1)
 		goto done;
 
 	/* Open inode. */
@@ -184,16 +392,22 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode == NULL)
 		goto done;
 
-	/* Erase directory entry. */
+	/* Erase directory entry, leaving a deleted slot behind. */
 	e.in_use = false;
-	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+	e.deleted = true;
+	h.entry_cnt--;
+	h.deleted_cnt++;
+	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+			|| !write_header (dir, &h))
 		goto done;
 
 	/* Remove inode. */
 	inode_remove (inode);
+	dcache_insert (inode_get_inumber (dir->inode), name, 0);
 	success = true;
 
 done:
+	inode_unlock_dir (dir->inode);
 	inode_close (inode);
 	return success;
 }
@@ -205,12 +419,22 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
 
+	bool success = false;
+
+	inode_lock_dir (dir->inode);
+
+	/* Skip the header. */
+	if (dir->pos < DIR_SLOT_OFS (0))
+		dir->pos = DIR_SLOT_OFS (0);
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			success = true;
+			break;
 		}
 	}
-	return false;
+
+	inode_unlock_dir (dir->inode);
+	return success;
 }
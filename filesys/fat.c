@@ -1,4 +1,5 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
@@ -22,10 +23,18 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
+	cluster_t last_clst;        /* No cluster below this one is free. */
+	unsigned int free_cnt;      /* Number of free clusters. */
+	struct bitmap *dirty;       /* FAT sectors changed since loaded. */
 	struct lock write_lock;
 };
 
+/* Most FAT sectors moved by one disk command. */
+#define FAT_RUN_MAX 64
+
+/* FAT entries per FAT sector. */
+#define ENTRIES_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (cluster_t))
+
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
@@ -51,37 +60,70 @@ fat_init (void) {
 	fat_fs_init ();
 }
 
+/* Allocates the in-memory FAT, rounded up to whole sectors so that
+ * each FAT sector can be moved to and from the disk in place. */
+static void
+fat_alloc_table (void) {
+	ASSERT (fat_fs->fat == NULL);
+
+	fat_fs->fat = calloc (fat_fs->bs.fat_sectors, DISK_SECTOR_SIZE);
+	fat_fs->dirty = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->fat == NULL || fat_fs->dirty == NULL)
+		PANIC ("FAT load failed");
+}
+
+/* Moves the CNT FAT sectors starting at FAT sector IDX between
+ * memory and the disk, FAT_RUN_MAX at a time. */
+static void
+fat_transfer (size_t idx, size_t cnt, bool write) {
+	uint8_t *table = (uint8_t *) fat_fs->fat;
+	void *buffers[FAT_RUN_MAX];
+
+	while (cnt > 0) {
+		size_t run = cnt < FAT_RUN_MAX ? cnt : FAT_RUN_MAX;
+		disk_sector_t sector = fat_fs->bs.fat_start + idx;
+		size_t i;
+
+		for (i = 0; i < run; i++)
+			buffers[i] = table + (idx + i) * DISK_SECTOR_SIZE;
+		if (write)
+			disk_write_multiple (filesys_disk, sector, run,
+					(const void *const *) buffers);
+		else
+			disk_read_multiple (filesys_disk, sector, run, buffers);
+		idx += run;
+		cnt -= run;
+	}
+}
+
+/* Counts the free clusters and points the free-cluster hint at the
+ * first of them. */
+static void
+fat_count_free (void) {
+	cluster_t clst;
+
+	fat_fs->free_cnt = 0;
+	fat_fs->last_clst = fat_fs->fat_length;
+	for (clst = fat_fs->fat_length - 1; clst >= 1; clst--)
+		if (fat_fs->fat[clst] == 0) {
+			fat_fs->free_cnt++;
+			fat_fs->last_clst = clst;
+		}
+}
+
 void
 fat_open (void) {
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT load failed");
+	fat_alloc_table ();
 
 	// Load FAT directly from the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
-	}
+	fat_transfer (0, fat_fs->bs.fat_sectors, false);
+	fat_count_free ();
 }
 
 void
 fat_close (void) {
+	size_t start, end;
+
 	// Write FAT boot sector
 	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
 	if (bounce == NULL)
@@ -90,27 +132,22 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
+	// Write the changed FAT sectors directly to the disk
+	lock_acquire (&fat_fs->write_lock);
+	for (start = 0;
+			(start = bitmap_scan (fat_fs->dirty, start, 1, true)) != BITMAP_ERROR;
+			start = end) {
+		end = bitmap_scan (fat_fs->dirty, start, 1, false);
+		if (end == BITMAP_ERROR)
+			end = fat_fs->bs.fat_sectors;
+		fat_transfer (start, end - start, true);
 	}
+	lock_release (&fat_fs->write_lock);
+
+	free (fat_fs->fat);
+	bitmap_destroy (fat_fs->dirty);
+	fat_fs->fat = NULL;
+	fat_fs->dirty = NULL;
 }
 
 void
@@ -119,10 +156,10 @@ fat_create (void) {
 	fat_boot_create ();
 	fat_fs_init ();
 
-	// Create FAT table
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT creation failed");
+	// Create FAT table, all of which has to reach the disk
+	fat_alloc_table ();
+	bitmap_set_all (fat_fs->dirty, true);
+	fat_count_free ();
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -152,42 +189,236 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	unsigned int max_length = fat_fs->bs.fat_sectors * ENTRIES_PER_SECTOR;
+
+	/* Cluster 0 means "no cluster", so cluster 1 is the first one in
+	 * the data area. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	if (fat_fs->fat_length > max_length)
+		fat_fs->fat_length = max_length;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Sets the FAT entry of CLST to VAL, keeping the free count, the
+ * free-cluster hint and the dirty sectors up to date.  The caller
+ * must hold the write lock. */
+static void
+set_entry (cluster_t clst, cluster_t val) {
+	cluster_t old;
+
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+
+	old = fat_fs->fat[clst];
+	if (old == 0 && val != 0) {
+		fat_fs->free_cnt--;
+		if (clst == fat_fs->last_clst)
+			fat_fs->last_clst++;
+	} else if (old != 0 && val == 0) {
+		fat_fs->free_cnt++;
+		if (clst < fat_fs->last_clst)
+			fat_fs->last_clst = clst;
+	}
+	fat_fs->fat[clst] = val;
+	bitmap_mark (fat_fs->dirty, clst / ENTRIES_PER_SECTOR);
+}
+
+/* Returns a free cluster, preferring the one right after PREV, or 0
+ * if the disk is full.  The caller must hold the write lock. */
+static cluster_t
+find_free (cluster_t prev) {
+	cluster_t clst;
+
+	if (fat_fs->free_cnt == 0)
+		return 0;
+	if (prev != 0 && prev + 1 < fat_fs->fat_length
+			&& fat_fs->fat[prev + 1] == 0)
+		return prev + 1;
+
+	/* Nothing below the hint is free, and some cluster is. */
+	for (clst = fat_fs->last_clst; fat_fs->fat[clst] != 0; clst++)
+		ASSERT (clst + 1 < fat_fs->fat_length);
+	fat_fs->last_clst = clst;
+	return clst;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new_clst;
+
+	lock_acquire (&fat_fs->write_lock);
+	ASSERT (clst == 0 || fat_fs->fat[clst] == EOChain);
+	new_clst = find_free (clst);
+	if (new_clst != 0) {
+		set_entry (new_clst, EOChain);
+		if (clst != 0)
+			set_entry (clst, new_clst);
+	}
+	lock_release (&fat_fs->write_lock);
+	return new_clst;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		set_entry (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_fs->fat[clst];
+
+		set_entry (clst, 0);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	set_entry (clst, val);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Returns the cluster that holds SECTOR, a sector of the data area. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Cluster chain cache                                                        */
+/*----------------------------------------------------------------------------*/
+
+/* Initializes CHAIN as a cache of the chain starting at START, which
+ * may be 0 for an empty chain. */
+void
+fat_chain_init (struct fat_chain *chain, cluster_t start) {
+	chain->start = start;
+	chain->clusters = NULL;
+	chain->cnt = 0;
+	chain->capacity = 0;
+}
+
+/* Records CLST as cluster IDX of CHAIN, if it is the first cluster
+ * not known yet.  Without memory to grow the cache, it is not
+ * recorded, which only costs another walk of the FAT later. */
+static void
+chain_remember (struct fat_chain *chain, size_t idx, cluster_t clst) {
+	if (idx != chain->cnt)
+		return;
+	if (chain->cnt == chain->capacity) {
+		size_t capacity = chain->capacity > 0 ? 2 * chain->capacity : 16;
+		cluster_t *clusters;
+
+		clusters = realloc (chain->clusters, capacity * sizeof *clusters);
+		if (clusters == NULL)
+			return;
+		chain->clusters = clusters;
+		chain->capacity = capacity;
+	}
+	chain->clusters[chain->cnt++] = clst;
+}
+
+/* Returns cluster IDX of CHAIN, counting from 0, or 0 if the chain
+ * is shorter than that.  Clusters walked past on the way are
+ * remembered, so each one is looked up in the FAT only once. */
+cluster_t
+fat_chain_get (struct fat_chain *chain, size_t idx) {
+	cluster_t clst;
+	size_t i;
+
+	if (idx < chain->cnt)
+		return chain->clusters[idx];
+	if (chain->start == 0)
+		return 0;
+
+	/* Resume from the last cluster known, which is number I. */
+	if (chain->cnt > 0) {
+		i = chain->cnt - 1;
+		clst = chain->clusters[i];
+	} else {
+		i = 0;
+		clst = chain->start;
+		chain_remember (chain, 0, clst);
+	}
+	for (; i < idx; i++) {
+		clst = fat_get (clst);
+		if (clst == EOChain)
+			return 0;
+		chain_remember (chain, i + 1, clst);
+	}
+	return clst;
+}
+
+/* Adds a new cluster to the end of CHAIN, starting the chain if it is
+ * empty, and returns it, or 0 if the disk is full. */
+cluster_t
+fat_chain_append (struct fat_chain *chain) {
+	cluster_t last = 0, clst;
+	size_t cnt = 0;
+
+	/* Find the last cluster, which is number CNT - 1. */
+	if (chain->start != 0) {
+		cnt = chain->cnt > 0 ? chain->cnt : 1;
+		last = fat_chain_get (chain, cnt - 1);
+		while ((clst = fat_get (last)) != EOChain) {
+			chain_remember (chain, cnt++, clst);
+			last = clst;
+		}
+	}
+
+	clst = fat_create_chain (last);
+	if (clst != 0) {
+		if (cnt == 0)
+			chain->start = clst;
+		chain_remember (chain, cnt, clst);
+	}
+	return clst;
+}
+
+/* Forgets all but the first CNT clusters of CHAIN, after the rest
+ * have been removed from the chain.  To cache another chain, destroy
+ * CHAIN and initialize it again. */
+void
+fat_chain_truncate (struct fat_chain *chain, size_t cnt) {
+	if (cnt == 0)
+		chain->start = 0;
+	if (chain->cnt > cnt)
+		chain->cnt = cnt;
+}
+
+/* Frees the memory held by CHAIN. */
+void
+fat_chain_destroy (struct fat_chain *chain) {
+	free (chain->clusters);
+	chain->clusters = NULL;
+	chain->cnt = chain->capacity = 0;
 }
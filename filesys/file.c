@@ -1,29 +1,53 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/disk.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+
+/* Readahead window, in sectors: its size when a file first reads
+ * sequentially, and the limit it doubles up to while it goes on
+ * doing so. */
+#define READAHEAD_MIN 4
+#define READAHEAD_MAX 64
 
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+
+	/* Sequential access detection. */
+	off_t ra_next;              /* Where a sequential read would start. */
+	off_t ra_end;               /* End of the data read ahead so far. */
+	off_t ra_window;            /* Sectors to keep ahead; 0 if random. */
 };
 
+/* Object cache for open files. */
+static struct slab_cache file_slab;
+
+/* Initializes the file module. */
+void
+file_init (void) {
+	slab_cache_init (&file_slab, "file", sizeof (struct file), NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) {
-	struct file *file = calloc (1, sizeof *file);
+	struct file *file = slab_alloc (&file_slab);
 	if (inode != NULL && file != NULL) {
 		file->inode = inode;
 		file->pos = 0;
 		file->deny_write = false;
+		file->ra_next = 0;
+		file->ra_end = 0;
+		file->ra_window = 0;
 		return file;
 	} else {
 		inode_close (inode);
-		free (file);
+		slab_free (&file_slab, file);
 		return NULL;
 	}
 }
@@ -54,7 +78,7 @@ file_close (struct file *file) {
 	if (file != NULL) {
 		file_allow_write (file);
 		inode_close (file->inode);
-		free (file);
+		slab_free (&file_slab, file);
 	}
 }
 
@@ -64,6 +88,39 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Notes that BYTES bytes were just read at OFS in FILE.  While reads
+ * follow each other, keeps the next window of sectors on its way into
+ * the buffer cache, and doubles the window every time it is moved on.
+ * A read anywhere else closes the window. */
+static void
+file_readahead (struct file *file, off_t ofs, off_t bytes) {
+	off_t next = ofs + bytes;
+	off_t start, end;
+
+	if (bytes == 0)
+		return;
+	if (ofs != file->ra_next) {
+		file->ra_next = next;
+		file->ra_end = next;
+		file->ra_window = 0;
+		return;
+	}
+	file->ra_next = next;
+	if (file->ra_window == 0)
+		file->ra_window = READAHEAD_MIN;
+
+	/* Move the window on once the reader is halfway through it. */
+	start = file->ra_end > next ? file->ra_end : next;
+	end = next + file->ra_window * DISK_SECTOR_SIZE;
+	if (end - start < file->ra_window * DISK_SECTOR_SIZE / 2)
+		return;
+
+	inode_readahead (file->inode, start, end - start);
+	file->ra_end = end;
+	if (file->ra_window < READAHEAD_MAX)
+		file->ra_window *= 2;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -72,6 +129,7 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	file_readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,15 +141,16 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+	file_readahead (file, file_ofs, bytes_read);
+	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
@@ -103,9 +162,8 @@ file_write (struct file *file, const void *buffer, off_t size) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -1,13 +1,128 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <rbtree.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* The bitmap is the free map as stored on disk.  In memory, its runs
+ * of free sectors are also kept as extents in two trees, one ordered
+ * by start sector and one by length.  The first finds the extent
+ * around an allocation goal and the neighbours a released run merges
+ * with; the second finds the smallest extent that fits, so both
+ * allocation and release take O(log n) in the number of free runs
+ * instead of a scan of the bitmap. */
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
 
+/* A run of free sectors. */
+struct extent {
+	disk_sector_t start;             /* First sector. */
+	size_t length;                   /* Number of sectors. */
+	struct rb_elem by_start;         /* Element in EXTENTS_BY_START. */
+	struct rb_elem by_length;        /* Element in EXTENTS_BY_LENGTH. */
+};
+
+static struct rb_tree extents_by_start;
+static struct rb_tree extents_by_length;
+static struct slab_cache extent_slab;
+
+/* Protects the free map and the extent trees. */
+static struct lock free_map_lock;
+
+/* Free extents past an allocation goal that are looked at for one
+ * large enough, before falling back to the best fit. */
+#define GOAL_SCAN_EXTENTS 16
+
+/* Returns true if extent A starts before B. */
+static bool
+start_less (const struct rb_elem *a, const struct rb_elem *b,
+		void *aux UNUSED) {
+	return rb_entry (a, struct extent, by_start)->start
+		< rb_entry (b, struct extent, by_start)->start;
+}
+
+/* Returns true if extent A is shorter than B, or as long and starts
+ * before it. */
+static bool
+length_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct extent *a = rb_entry (a_, struct extent, by_length);
+	const struct extent *b = rb_entry (b_, struct extent, by_length);
+
+	if (a->length != b->length)
+		return a->length < b->length;
+	return a->start < b->start;
+}
+
+/* Adds the free run of LENGTH sectors at START to the trees, as
+ * extent E if it is non-null or as a new extent otherwise.  Returns
+ * false if no memory is available for a new extent. */
+static bool
+extent_insert (struct extent *e, disk_sector_t start, size_t length) {
+	if (e == NULL && (e = slab_alloc (&extent_slab)) == NULL)
+		return false;
+	e->start = start;
+	e->length = length;
+	rb_insert (&extents_by_start, &e->by_start);
+	rb_insert (&extents_by_length, &e->by_length);
+	return true;
+}
+
+/* Removes extent E from the trees. */
+static void
+extent_remove (struct extent *e) {
+	rb_remove (&extents_by_start, &e->by_start);
+	rb_remove (&extents_by_length, &e->by_length);
+}
+
+/* Returns the extent that holds SECTOR, or NULL. */
+static struct extent *
+extent_at (disk_sector_t sector) {
+	struct extent key = { .start = sector };
+	struct rb_elem *e;
+	struct extent *ext;
+
+	e = rb_floor (&extents_by_start, &key.by_start);
+	if (e == NULL)
+		return NULL;
+	ext = rb_entry (e, struct extent, by_start);
+	return sector < ext->start + ext->length ? ext : NULL;
+}
+
+/* Frees extent E, for rb_clear(). */
+static void
+extent_destroy (struct rb_elem *e, void *aux UNUSED) {
+	slab_free (&extent_slab, rb_entry (e, struct extent, by_start));
+}
+
+/* Rebuilds the extent trees from the bitmap. */
+static void
+build_extents (void) {
+	size_t sector_cnt = bitmap_size (free_map);
+	size_t start = 0;
+
+	rb_clear (&extents_by_length, NULL);
+	rb_clear (&extents_by_start, extent_destroy);
+	for (;;) {
+		size_t end;
+
+		start = bitmap_scan (free_map, start, 1, false);
+		if (start == BITMAP_ERROR)
+			break;
+		end = bitmap_scan (free_map, start, 1, true);
+		if (end == BITMAP_ERROR)
+			end = sector_cnt;
+		if (!extent_insert (NULL, start, end - start))
+			PANIC ("out of memory for free extents");
+		start = end;
+	}
+}
+
 /* Initializes the free map. */
 void
 free_map_init (void) {
@@ -16,6 +131,111 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+
+	rb_init (&extents_by_start, start_less, NULL);
+	rb_init (&extents_by_length, length_less, NULL);
+	slab_cache_init (&extent_slab, "extent", sizeof (struct extent), NULL);
+	lock_init (&free_map_lock);
+	build_extents ();
+}
+
+/* Chooses CNT free sectors, preferably starting at GOAL, or else
+ * from the first of the GOAL_SCAN_EXTENTS free extents after it that
+ * is large enough, and otherwise from the smallest free extent that
+ * is.  Removes them from the extent trees and returns the first, or
+ * BITMAP_ERROR if there is no room. */
+static disk_sector_t
+take_extent (size_t cnt, disk_sector_t goal) {
+	struct extent key = { .start = goal, .length = cnt };
+	struct extent *e = NULL;
+	struct rb_elem *elem;
+	disk_sector_t sector;
+	size_t end, i;
+
+	/* GOAL itself, or the first extent after it that fits. */
+	if (goal != 0) {
+		e = extent_at (goal);
+		if (e == NULL || goal + cnt > e->start + e->length) {
+			e = NULL;
+			elem = rb_lower_bound (&extents_by_start, &key.by_start);
+			for (i = 0; elem != NULL && i < GOAL_SCAN_EXTENTS;
+					i++, elem = rb_next (elem)) {
+				struct extent *next = rb_entry (elem, struct extent, by_start);
+				if (next->length >= cnt) {
+					e = next;
+					break;
+				}
+			}
+		}
+	}
+
+	/* Best fit. */
+	if (e == NULL) {
+		key.start = 0;
+		elem = rb_lower_bound (&extents_by_length, &key.by_length);
+		if (elem == NULL)
+			return BITMAP_ERROR;
+		e = rb_entry (elem, struct extent, by_length);
+	}
+
+	end = e->start + e->length;
+	sector = e->start < goal && goal + cnt <= end ? goal : e->start;
+
+	/* Keep what is left on either side. */
+	extent_remove (e);
+	if (sector > e->start) {
+		if (sector + cnt < end
+				&& !extent_insert (NULL, sector + cnt, end - sector - cnt)) {
+			extent_insert (e, e->start, e->length);
+			return BITMAP_ERROR;
+		}
+		extent_insert (e, e->start, sector - e->start);
+	} else if (sector + cnt < end)
+		extent_insert (e, sector + cnt, end - sector - cnt);
+	else
+		slab_free (&extent_slab, e);
+	return sector;
+}
+
+/* Returns the CNT sectors at SECTOR to the extent trees, merging
+ * them with the free extents on either side. */
+static void
+give_extent (disk_sector_t sector, size_t cnt) {
+	struct extent key = { .start = sector };
+	struct extent *prev = NULL, *next = NULL;
+	struct rb_elem *elem;
+
+	elem = rb_floor (&extents_by_start, &key.by_start);
+	if (elem != NULL) {
+		prev = rb_entry (elem, struct extent, by_start);
+		if (prev->start + prev->length != sector)
+			prev = NULL;
+	}
+	elem = rb_lower_bound (&extents_by_start, &key.by_start);
+	if (elem != NULL) {
+		next = rb_entry (elem, struct extent, by_start);
+		if (next->start != sector + cnt)
+			next = NULL;
+	}
+
+	if (prev != NULL) {
+		extent_remove (prev);
+		sector = prev->start;
+		cnt += prev->length;
+	}
+	if (next != NULL) {
+		extent_remove (next);
+		cnt += next->length;
+		if (prev != NULL) {
+			slab_free (&extent_slab, next);
+			next = NULL;
+		}
+	}
+
+	/* A run with no free neighbours needs a new extent.  Without
+	 * memory for one, it stays free in the bitmap only, until the
+	 * extents are rebuilt at the next mount. */
+	extent_insert (prev != NULL ? prev : next, sector, cnt);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,13 +244,30 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+	return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate(), but tries to place the sectors at GOAL,
+ * or close after it, so that data written in sequence stays
+ * contiguous on disk.  A GOAL of 0 means no preference. */
+bool
+free_map_allocate_near (size_t cnt, disk_sector_t goal,
+		disk_sector_t *sectorp) {
+	disk_sector_t sector;
+
+	lock_acquire (&free_map_lock);
+	sector = take_extent (cnt, goal);
+	if (sector != BITMAP_ERROR) {
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		if (free_map_file != NULL
+				&& !bitmap_write_range (free_map, free_map_file, sector, cnt)) {
+			bitmap_set_multiple (free_map, sector, cnt, false);
+			give_extent (sector, cnt);
+			sector = BITMAP_ERROR;
+		}
 	}
+	lock_release (&free_map_lock);
+
 	if (sector != BITMAP_ERROR)
 		*sectorp = sector;
 	return sector != BITMAP_ERROR;
@@ -39,9 +276,13 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	if (free_map_file != NULL)
+		bitmap_write_range (free_map, free_map_file, sector, cnt);
+	give_extent (sector, cnt);
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -52,6 +293,7 @@ free_map_open (void) {
 		PANIC ("can't open free map");
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+	build_extents ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -1,23 +1,65 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#include "filesys/page_cache.h"
+#endif
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Inodes kept in memory after their last close. */
+#define CLOSED_INODE_MAX 32
+
+/* Sector pointers in an inode and in an index sector. */
+#define DIRECT_CNT 124
+#define INDIRECT_CNT (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+
+/* Largest file, in sectors. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + INDIRECT_CNT * INDIRECT_CNT)
+
+#ifdef EFILESYS
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ *
+ * The data is the chain of clusters in the FAT that starts at START.
+ * A file grows by appending clusters of zeros to its chain, so,
+ * unlike with the free map, it has no holes. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
+	cluster_t start;                    /* First data cluster, or 0. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
 	uint32_t unused[125];               /* Not used. */
 };
+#else
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ *
+ * Data sector I of the file is DIRECT[I] for the first DIRECT_CNT
+ * sectors, then entry I - DIRECT_CNT of the index sector INDIRECT,
+ * and after that an entry of one of the index sectors listed in
+ * DOUBLY_INDIRECT.  A pointer of 0, which is never a data sector,
+ * stands for a hole that reads as zeros; writing to a hole fills it
+ * in. */
+struct inode_disk {
+	disk_sector_t direct[DIRECT_CNT];   /* Data sectors. */
+	disk_sector_t indirect;             /* Index of data sectors. */
+	disk_sector_t doubly_indirect;      /* Index of index sectors. */
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+};
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -28,40 +70,284 @@ bytes_to_sectors (off_t size) {
 
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in OPEN_INODES. */
+	struct list_elem lru_elem;          /* Element in CLOSED_INODES. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
+	bool busy;                          /* Being read in or dropped? */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	struct lock dir_lock;               /* Serializes directory changes. */
+	struct lock lock;                   /* Protects the members below. */
+#ifdef EFILESYS
+	struct fat_chain chain;             /* Data clusters looked up so far. */
+#else
+	disk_sector_t next_alloc;           /* Goal for the next new sector. */
+#endif
 	struct inode_disk data;             /* Inode content. */
 };
 
+#ifdef EFILESYS
+/* Appends a cluster of zeros to CHAIN and returns it, or 0 if the
+ * disk is full. */
+static cluster_t
+append_cluster (struct fat_chain *chain) {
+	static char zeros[DISK_SECTOR_SIZE];
+	cluster_t clst = fat_chain_append (chain);
+
+	if (clst != 0)
+		buffer_cache_write (cluster_to_sector (clst), zeros, 0,
+				DISK_SECTOR_SIZE);
+	return clst;
+}
+
 /* Returns the disk sector that contains byte offset POS within
- * INODE.
- * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
+ * INODE, or 0 if POS is past the end of its chain.  If ALLOCATE is
+ * true, extends the chain to POS first, returning 0 only if the disk
+ * is full. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos, bool allocate) {
+	size_t idx = pos / DISK_SECTOR_SIZE;
+	cluster_t clst;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
+	ASSERT (pos >= 0);
+
+	lock_acquire (&inode->lock);
+	clst = fat_chain_get (&inode->chain, idx);
+	while (clst == 0 && allocate && append_cluster (&inode->chain) != 0)
+		clst = fat_chain_get (&inode->chain, idx);
+	if (inode->data.start != inode->chain.start) {
+		inode->data.start = inode->chain.start;
+		buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	}
+	lock_release (&inode->lock);
+	return clst != 0 ? cluster_to_sector (clst) : 0;
+}
+
+/* Releases every cluster the file DATA describes holds. */
+static void
+free_sectors (struct inode_disk *data) {
+	if (data->start != 0)
+		fat_remove_chain (data->start, 0);
+}
+
+/* Gives DATA, the inode to be written to SECTOR, its first SECTORS
+ * sectors of zeros.  Returns false, with none of them allocated, if
+ * the disk is full. */
+static bool
+alloc_data (struct inode_disk *data, disk_sector_t sector UNUSED,
+		size_t sectors) {
+	struct fat_chain chain;
+	bool success = true;
+	size_t i;
+
+	fat_chain_init (&chain, 0);
+	for (i = 0; i < sectors && success; i++)
+		success = append_cluster (&chain) != 0;
+	data->start = chain.start;
+	fat_chain_destroy (&chain);
+	if (!success)
+		free_sectors (data);
+	return success;
+}
+#else
+
+/* Points *SECTORP to a newly allocated sector of zeros, unless it
+ * points to a sector already.  The sector is placed at *GOAL if
+ * possible, and *GOAL moves on to the sector after it, so that a
+ * file written in order is laid out in order.  Returns false if the
+ * disk is full. */
+static bool
+alloc_sector (disk_sector_t *sectorp, disk_sector_t *goal) {
+	static char zeros[DISK_SECTOR_SIZE];
+
+	if (*sectorp != 0)
+		return true;
+	if (!free_map_allocate_near (1, *goal, sectorp))
+		return false;
+	buffer_cache_write (*sectorp, zeros, 0, DISK_SECTOR_SIZE);
+	*goal = *sectorp + 1;
+	return true;
+}
+
+/* Returns entry IDX of index sector TABLE.  If the entry is 0 and
+ * GOAL is non-null, allocates a sector for it first, as
+ * alloc_sector().  Returns 0 for a hole, or if the disk is full. */
+static disk_sector_t
+index_get (disk_sector_t table, size_t idx, disk_sector_t *goal) {
+	disk_sector_t sector;
+
+	buffer_cache_read (table, &sector, idx * sizeof sector, sizeof sector);
+	if (sector == 0 && goal != NULL && alloc_sector (&sector, goal))
+		buffer_cache_write (table, &sector, idx * sizeof sector,
+				sizeof sector);
+	return sector;
+}
+
+/* Returns the disk sector that holds sector IDX of the file DATA
+ * describes, or 0 if there is none.  If GOAL is non-null, missing
+ * sectors are allocated on the way, as alloc_sector(), and *CHANGED
+ * is set to true if DATA itself was changed.  Returns 0 in that case
+ * only if the disk is full or IDX is past the largest file. */
+static disk_sector_t
+index_to_sector (struct inode_disk *data, size_t idx, disk_sector_t *goal,
+		bool *changed) {
+	disk_sector_t *top;
+
+	if (idx < DIRECT_CNT) {
+		top = &data->direct[idx];
+		if (*top == 0 && goal != NULL && alloc_sector (top, goal))
+			*changed = true;
+		return *top;
+	}
+
+	idx -= DIRECT_CNT;
+	if (idx < INDIRECT_CNT)
+		top = &data->indirect;
+	else if ((idx -= INDIRECT_CNT) < INDIRECT_CNT * INDIRECT_CNT)
+		top = &data->doubly_indirect;
 	else
-		return -1;
+		return 0;
+
+	if (*top == 0) {
+		if (goal == NULL || !alloc_sector (top, goal))
+			return 0;
+		*changed = true;
+	}
+	if (top == &data->indirect)
+		return index_get (*top, idx, goal);
+	else {
+		disk_sector_t table = index_get (*top, idx / INDIRECT_CNT, goal);
+		return table != 0 ? index_get (table, idx % INDIRECT_CNT, goal) : 0;
+	}
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE, or 0 if POS falls into a hole.  If ALLOCATE is true, fills
+ * the hole in first, returning 0 only if that fails. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos, bool allocate) {
+	bool changed = false;
+	disk_sector_t sector;
+
+	ASSERT (inode != NULL);
+	ASSERT (pos >= 0);
+
+	lock_acquire (&inode->lock);
+	sector = index_to_sector (&inode->data, pos / DISK_SECTOR_SIZE,
+			allocate ? &inode->next_alloc : NULL, &changed);
+	if (changed)
+		buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	lock_release (&inode->lock);
+	return sector;
+}
+
+/* Releases index sector TABLE, and the sectors it lists.  LEVEL is 1
+ * for a sector that lists data sectors, 2 for one that lists such
+ * index sectors. */
+static void
+free_index (disk_sector_t table, int level) {
+	disk_sector_t entries[INDIRECT_CNT];
+	size_t i;
+
+	buffer_cache_read (table, entries, 0, DISK_SECTOR_SIZE);
+	for (i = 0; i < INDIRECT_CNT; i++)
+		if (entries[i] != 0) {
+			if (level > 1)
+				free_index (entries[i], level - 1);
+			else
+				free_map_release (entries[i], 1);
+		}
+	free_map_release (table, 1);
+}
+
+/* Releases every sector the file DATA describes holds. */
+static void
+free_sectors (struct inode_disk *data) {
+	size_t i;
+
+	for (i = 0; i < DIRECT_CNT; i++)
+		if (data->direct[i] != 0)
+			free_map_release (data->direct[i], 1);
+	if (data->indirect != 0)
+		free_index (data->indirect, 1);
+	if (data->doubly_indirect != 0)
+		free_index (data->doubly_indirect, 2);
+}
+
+/* Gives DATA, the inode to be written to SECTOR, its first SECTORS
+ * sectors of zeros, laid out right after SECTOR if possible.  Returns
+ * false, with none of them allocated, if the disk is full. */
+static bool
+alloc_data (struct inode_disk *data, disk_sector_t sector, size_t sectors) {
+	disk_sector_t goal = sector + 1;
+	bool changed;
+	size_t i;
+
+	if (sectors > MAX_SECTORS)
+		return false;
+	for (i = 0; i < sectors; i++)
+		if (index_to_sector (data, i, &goal, &changed) == 0) {
+			free_sectors (data);
+			return false;
+		}
+	return true;
+}
+#endif
+
+/* In-memory inodes by sector, so that opening a single inode twice
+ * returns the same `struct inode'.  Besides the open inodes, it
+ * holds the CLOSED_INODE_MAX that were closed last, and not removed,
+ * so that reopening one of them costs neither an allocation nor a
+ * read of its sector.  An inode whose sector is being read in, or
+ * whose cached pages are being dropped on its way out, stays in the
+ * table marked BUSY while INODES_LOCK is released for the I/O, and
+ * opening it waits on INODES_READY until it is not. */
+static struct hash open_inodes;
+/* Closed inodes in OPEN_INODES, most recently closed first. */
+static struct list closed_inodes;
+/* Protects the members above, each inode's OPEN_CNT and BUSY, and
+ * the statistics. */
+static struct lock inodes_lock;
+/* Signaled under INODES_LOCK when an inode stops being BUSY. */
+static struct condition inodes_ready;
+
+/* Statistics. */
+static long long open_cnt;              /* inode_open() calls. */
+static long long closed_hit_cnt;        /* Of those, served by a closed inode. */
+
+/* Object cache for in-memory inodes. */
+static struct slab_cache inode_slab;
+
+/* Returns a hash value for inode E. */
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns true if inode A's sector precedes B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	hash_init (&open_inodes, inode_hash, inode_less, NULL);
+	list_init (&closed_inodes);
+	lock_init (&inodes_lock);
+	cond_init (&inodes_ready);
+	slab_cache_init (&inode_slab, "inode", sizeof (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
- * disk.
+ * disk.  The data sectors are allocated up front, so that a file
+ * created with a size does not run out of space later.
  * Returns true if successful.
  * Returns false if memory or disk allocation fails. */
 bool
@@ -77,20 +363,11 @@ inode_create (disk_sector_t sector, off_t length) {
 
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		success = alloc_data (disk_inode, sector, bytes_to_sectors (length));
+		if (success)
+			buffer_cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
 		free (disk_inode);
 	}
 	return success;
@@ -101,39 +378,70 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+	struct inode key;
+	struct hash_elem *e;
 	struct inode *inode;
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
+	lock_acquire (&inodes_lock);
+	open_cnt++;
+
+	/* Check whether this inode is already in memory, waiting for one
+	 * that is being read in or dropped. */
+	key.sector = sector;
+	while ((e = hash_find (&open_inodes, &key.elem)) != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		if (inode->busy) {
+			cond_wait (&inodes_ready, &inodes_lock);
+			continue;
 		}
+		if (inode->open_cnt++ == 0) {
+			list_remove (&inode->lru_elem);
+			closed_hit_cnt++;
+		}
+		lock_release (&inodes_lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	inode = slab_alloc (&inode_slab);
+	if (inode == NULL) {
+		lock_release (&inodes_lock);
 		return NULL;
+	}
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize, and read the sector in without the lock. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
+	inode->busy = true;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	lock_init (&inode->dir_lock);
+	lock_init (&inode->lock);
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&inodes_lock);
+
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+#ifdef EFILESYS
+	fat_chain_init (&inode->chain, inode->data.start);
+#else
+	inode->next_alloc = sector + 1;
+#endif
+
+	lock_acquire (&inodes_lock);
+	inode->busy = false;
+	cond_broadcast (&inodes_ready, &inodes_lock);
+	lock_release (&inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&inodes_lock);
 		inode->open_cnt++;
+		lock_release (&inodes_lock);
+	}
 	return inode;
 }
 
@@ -144,7 +452,8 @@ inode_get_inumber (const struct inode *inode) {
 }
 
 /* Closes INODE and writes it to disk.
- * If this was the last reference to INODE, frees its memory.
+ * If this was the last reference to INODE, its memory is freed,
+ * now or once it drops out of the closed inodes.
  * If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) {
@@ -152,20 +461,49 @@ inode_close (struct inode *inode) {
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+	lock_acquire (&inodes_lock);
+	if (--inode->open_cnt > 0) {
+		lock_release (&inodes_lock);
+		return;
+	}
 
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+	/* Keep the last opener's inode around for a while, unless it is
+	 * to be deleted. */
+	if (!inode->removed) {
+		list_push_front (&closed_inodes, &inode->lru_elem);
+		if (list_size (&closed_inodes) <= CLOSED_INODE_MAX) {
+			lock_release (&inodes_lock);
+			return;
 		}
+		inode = list_entry (list_pop_back (&closed_inodes), struct inode,
+				lru_elem);
+	}
 
-		free (inode); 
+	/* Nobody can open the inode anew, and miss the cached data, until
+	 * it has left the table. */
+	inode->busy = true;
+	lock_release (&inodes_lock);
+#ifdef EFILESYS
+	page_cache_drop (inode, !inode->removed);
+#endif
+	lock_acquire (&inodes_lock);
+	hash_delete (&open_inodes, &inode->elem);
+	cond_broadcast (&inodes_ready, &inodes_lock);
+	lock_release (&inodes_lock);
+
+	/* Deallocate blocks if removed. */
+	if (inode->removed) {
+#ifdef EFILESYS
+		fat_remove_chain (sector_to_cluster (inode->sector), 0);
+#else
+		free_map_release (inode->sector, 1);
+#endif
+		free_sectors (&inode->data);
 	}
+#ifdef EFILESYS
+	fat_chain_destroy (&inode->chain);
+#endif
+	slab_free (&inode_slab, inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -180,14 +518,25 @@ inode_remove (struct inode *inode) {
  * Returns the number of bytes actually read, which may be less
  * than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+#ifdef EFILESYS
+	return page_cache_read (inode, buffer, size, offset);
+#else
+	return inode_read_direct (inode, buffer, size, offset);
+#endif
+}
+
+/* Like inode_read_at(), but reads the disk, through the buffer cache,
+ * even if the data is in the page cache. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx = byte_to_sector (inode, offset, false);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -200,89 +549,112 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		if (sector_idx != 0)
+			buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
+		else
+			memset (buffer + bytes_read, 0, chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
+/* Asks the buffer cache to read the sectors that hold SIZE bytes at
+ * OFFSET in INODE, without waiting for them. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end = offset + size;
+	disk_sector_t first = 0;
+	size_t cnt = 0;
+
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+
+	/* Batch runs of consecutive sectors into one request each. */
+	for (offset = ROUND_DOWN (offset, DISK_SECTOR_SIZE); offset < end;
+			offset += DISK_SECTOR_SIZE) {
+		disk_sector_t sector = byte_to_sector (inode, offset, false);
+
+		if (cnt > 0 && sector == first + cnt)
+			cnt++;
+		else {
+			if (cnt > 0)
+				buffer_cache_readahead (first, cnt);
+			/* Holes need no reading. */
+			first = sector;
+			cnt = sector != 0;
+		}
+	}
+	if (cnt > 0)
+		buffer_cache_readahead (first, cnt);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * A write past the end of file extends it; any gap left between
+ * the old end and OFFSET is a hole that takes no space, or, on the
+ * FAT, is filled with zeros.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	off_t bytes_written = inode_write_direct (inode, buffer, size, offset);
+
+#ifdef EFILESYS
+	/* Bring cached copies of the data up to date. */
+	page_cache_update (inode, buffer, bytes_written, offset);
+#endif
+	return bytes_written;
+}
+
+/* Like inode_write_at(), but leaves the page cache alone.  For the
+ * page cache's own write-back. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_direct (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	if (inode->deny_write_cnt)
 		return 0;
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx = byte_to_sector (inode, offset, true);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		/* Bytes left in sector. */
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
 		/* Number of bytes to actually write into this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
+		int chunk_size = size < sector_left ? size : sector_left;
+		if (sector_idx == 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* The cache reads the sector in first unless the chunk
+		   covers all of it. */
+		buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+
+	/* Extend the file only once the new data is in place, so that
+	 * readers never see the new length with stale contents. */
+	lock_acquire (&inode->lock);
+	if (offset > inode->data.length) {
+		inode->data.length = offset;
+		buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	}
+	lock_release (&inode->lock);
 
 	return bytes_written;
 }
@@ -306,6 +678,26 @@ inode_allow_write (struct inode *inode) {
 	inode->deny_write_cnt--;
 }
 
+/* Acquires the lock that directory operations on INODE hold while
+ * they read and change its entries. */
+void
+inode_lock_dir (struct inode *inode) {
+	lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the lock acquired by inode_lock_dir(). */
+void
+inode_unlock_dir (struct inode *inode) {
+	lock_release (&inode->dir_lock);
+}
+
+/* Prints inode statistics. */
+void
+inode_print_stats (void) {
+	printf ("Inodes: %lld opens, %lld of closed inodes\n",
+			open_cnt, closed_hit_cnt);
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
@@ -1,9 +1,58 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
 
+   File data is cached a page at a time, in frames of the frame table.
+   Each cached page is a `struct page' of type VM_PAGE_CACHE owned by
+   the page cache's own kernel thread, "kworkerd", and found by (inode,
+   offset) through a hash table.  Its frame is evicted by the same clock
+   as the pages of user processes: the thread counts a fault for every
+   page it has to read in, so the clock sees the page cache as one more
+   working set, and memory goes to whichever of the cache and the
+   processes is using it.
+
+   inode_read_at() copies out of the cached pages, reading them in on a
+   miss, and inode_write_at() writes through to the buffer cache and
+   then updates the cached pages, if any.  Pages of file mappings are
+   not copied at all: their page table entries point at the cached
+   page's frame, so a process that mmap()s a file shares memory with
+   read() and write() and with every other process mapping it.  Those
+   mappings are the page's "mappers".  The clock considers a cached page
+   referenced if any mapper's accessed bit is set, and evicting it
+   unmaps the mappers first; their next access faults the page back in.
+
+   A page written through a mapping is written back when it is
+   evicted, by kworkerd every WRITEBACK_INTERVAL, by fsync(), when its
+   inode is freed, and at shutdown.  Evicted pages leave their `struct
+   page' behind in the table, to be freed later by a thread that holds
+   PC_LOCK.
+
+   Locks are taken in the order PC_LOCK, the frame table lock,
+   MAP_LOCK.  A PC_LOCK holder may wait for the eviction of a page to
+   finish, so nothing eviction calls may take PC_LOCK.  Writing a page
+   back goes through inode_write_direct(), which only takes the inode's
+   lock and the locks of the FAT and of the buffer cache: a page never
+   extends its file, and a file on the FAT has no holes to fill.
+   Eviction writes back with the frame marked as being evicted, and
+   flushing marks its pages BUSY and writes them without PC_LOCK. */
+
+#ifdef EFILESYS  /* For project 4 */
+#include "filesys/page_cache.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_kworkerd (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -13,38 +62,629 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
+/* Timer ticks between two write-backs by kworkerd. */
+#define WRITEBACK_INTERVAL (5 * TIMER_FREQ)
+
 tid_t page_cache_workerd;
 
+/* The thread that owns the cached pages, once it is running. */
+static struct thread *pc_owner;
+
+/* Cached pages, by (inode, offset). */
+static struct hash pc_table;
+/* Protects PC_TABLE and each page's BUSY, ACCESSED and
+ * WRITEBACK_ELEM. */
+static struct lock pc_lock;
+/* Signaled when a page is no longer BUSY. */
+static struct condition pc_ready;
+
+/* Evicted pages whose `struct page' is still to be freed. */
+static struct list evicted;
+/* Protects EVICTED and each page's MAPPERS, DIRTY and EVICTED, and
+ * the mappers' CACHE. */
+static struct lock map_lock;
+
+static struct slab_cache pc_slab;
+
+/* Statistics. */
+static size_t page_cnt;             /* Pages in the table. */
+static uint64_t hit_cnt;            /* Lookups of a resident page. */
+static uint64_t miss_cnt;           /* Pages read in. */
+static uint64_t writeback_cnt;      /* Pages written back. */
+
+/* Returns a hash value for cached page E. */
+static uint64_t
+pc_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page_cache *pc = hash_entry (e, struct page_cache, elem);
+	return hash_bytes (&pc->inode, sizeof pc->inode) ^ hash_int (pc->ofs);
+}
+
+/* Returns true if cached page A precedes B. */
+static bool
+pc_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = hash_entry (a_, struct page_cache, elem);
+	const struct page_cache *b = hash_entry (b_, struct page_cache, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+/* Returns the page that holds cached page PC. */
+static struct page *
+pc_page (struct page_cache *pc) {
+	return (struct page *) ((uint8_t *) pc - offsetof (struct page,
+				page_cache));
+}
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	struct semaphore started;
+
+	hash_init (&pc_table, pc_hash, pc_less, NULL);
+	lock_init (&pc_lock);
+	cond_init (&pc_ready);
+	list_init (&evicted);
+	lock_init (&map_lock);
+	slab_cache_init (&pc_slab, "page cache", sizeof (struct page), NULL);
+
+	sema_init (&started, 0);
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, &started);
+	if (page_cache_workerd == TID_ERROR)
+		PANIC ("can't start the page cache");
+	sema_down (&started);
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
-
+	return true;
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
 static bool
 page_cache_readahead (struct page *page, void *kva) {
+	struct page_cache *pc = &page->page_cache;
+	off_t read = inode_read_direct (pc->inode, kva, PGSIZE, pc->ofs);
+
+	/* Past the end of the file, the page reads as zeros. */
+	memset ((uint8_t *) kva + read, 0, PGSIZE - read);
+	return true;
+}
+
+/* Writes the part of PAGE's contents in KVA that lies within its file
+ * back to the file. */
+static void
+write_page (struct page *page, const void *kva) {
+	struct page_cache *pc = &page->page_cache;
+	off_t size = inode_length (pc->inode) - pc->ofs;
+
+	if (size > PGSIZE)
+		size = PGSIZE;
+	if (size > 0) {
+		inode_write_direct (pc->inode, kva, size, pc->ofs);
+		writeback_cnt++;
+	}
 }
 
-/* Utilze the Swap out mechanism to implement writeback */
+/* Moves the dirty bits of PC's mappers into PC and clears them, then
+ * returns and clears PC's own.  Must be called with MAP_LOCK held. */
+static bool
+take_dirty (struct page_cache *pc) {
+	struct list_elem *e;
+	bool dirty = pc->dirty;
+
+	for (e = list_begin (&pc->mappers); e != list_end (&pc->mappers);
+			e = list_next (e)) {
+		struct page *mapper = list_entry (e, struct page, file.cache_elem);
+		uint64_t *pml4 = mapper->owner->pml4;
+
+		if (pml4_is_dirty (pml4, mapper->va)) {
+			pml4_set_dirty (pml4, mapper->va, false);
+			dirty = true;
+		}
+	}
+	pc->dirty = false;
+	return dirty;
+}
+
+/* Removes MAPPER's mapping of its cached page, keeping the dirty bit.
+ * Must be called with MAP_LOCK held. */
+static void
+unmap (struct page *mapper) {
+	struct page_cache *pc = &mapper->file.cache->page_cache;
+	uint64_t *pml4 = mapper->owner->pml4;
+
+	if (pml4_is_dirty (pml4, mapper->va))
+		pc->dirty = true;
+	pml4_clear_page (pml4, mapper->va);
+	list_remove (&mapper->file.cache_elem);
+	mapper->file.cache = NULL;
+}
+
+/* Utilze the Swap out mechanism to implement writeback.  Called on a
+ * frame that nobody has pinned and that eviction has taken out of the
+ * frame table. */
 static bool
 page_cache_writeback (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	bool dirty;
+
+	lock_acquire (&map_lock);
+	while (!list_empty (&pc->mappers))
+		unmap (list_entry (list_front (&pc->mappers), struct page,
+					file.cache_elem));
+	dirty = pc->dirty;
+	pc->dirty = false;
+	if (!pc->evicted) {
+		list_push_back (&evicted, &pc->evicted_elem);
+		pc->evicted = true;
+	}
+	lock_release (&map_lock);
+
+	if (dirty)
+		write_page (page, page->frame->kva);
+	return true;
 }
 
-/* Destory the page_cache. */
+/* Destory the page_cache.  Its contents are discarded. */
 static void
 page_cache_destroy (struct page *page) {
+	struct frame *frame = vm_detach_frame (page);
+
+	if (frame != NULL) {
+		/* Not mapped in its owner's page table. */
+		frame->page = NULL;
+		page->frame = NULL;
+		vm_free_frame (frame);
+	}
+}
+
+/* Removes PC from the cache and frees it, after its frame is gone.
+ * Must be called with PC_LOCK held. */
+static void
+pc_free (struct page_cache *pc) {
+	struct page *page = pc_page (pc);
+
+	lock_acquire (&map_lock);
+	ASSERT (list_empty (&pc->mappers));
+	if (pc->evicted)
+		list_remove (&pc->evicted_elem);
+	lock_release (&map_lock);
+
+	hash_delete (&pc_table, &pc->elem);
+	page_cnt--;
+	destroy (page);
+	slab_free (&pc_slab, page);
+}
+
+/* Frees the evicted pages that have not been read in again.  Must be
+ * called with PC_LOCK held. */
+static void
+free_evicted (void) {
+	for (;;) {
+		struct page_cache *pc;
+
+		lock_acquire (&map_lock);
+		if (list_empty (&evicted)) {
+			lock_release (&map_lock);
+			return;
+		}
+		pc = list_entry (list_pop_front (&evicted), struct page_cache,
+				evicted_elem);
+		pc->evicted = false;
+		lock_release (&map_lock);
+
+		/* Only a PC_LOCK holder can start reading it in again. */
+		if (pc->busy)
+			continue;
+		if (vm_pin_frame (pc_page (pc)) != NULL)
+			vm_unpin_frame (pc_page (pc));
+		else
+			pc_free (pc);
+	}
+}
+
+/* Returns the cached page at OFS in INODE, reading it in if needed,
+ * with its frame pinned, or NULL if it cannot be read in.  The caller
+ * must drop the pin with vm_unpin_frame(). */
+static struct page *
+pc_get (struct inode *inode, off_t ofs) {
+	struct page_cache key;
+	struct page_cache *pc;
+	struct hash_elem *e;
+	struct page *page;
+
+	ASSERT (ofs % PGSIZE == 0);
+
+	key.inode = inode;
+	key.ofs = ofs;
+
+	lock_acquire (&pc_lock);
+	free_evicted ();
+	for (;;) {
+		e = hash_find (&pc_table, &key.elem);
+		if (e == NULL) {
+			page = slab_alloc (&pc_slab);
+			if (page == NULL) {
+				lock_release (&pc_lock);
+				return NULL;
+			}
+			memset (page, 0, sizeof *page);
+			page_cache_initializer (page, VM_PAGE_CACHE, NULL);
+			/* Not mapped anywhere; the offset only picks the frame's
+			 * cache colour. */
+			page->va = (void *) (uintptr_t) ofs;
+			page->owner = pc_owner;
+			pc = &page->page_cache;
+			pc->inode = inode;
+			pc->ofs = ofs;
+			list_init (&pc->mappers);
+			hash_insert (&pc_table, &pc->elem);
+			page_cnt++;
+			break;
+		}
+
+		pc = hash_entry (e, struct page_cache, elem);
+		page = pc_page (pc);
+		if (pc->busy) {
+			cond_wait (&pc_ready, &pc_lock);
+			continue;
+		}
+		if (vm_pin_frame (page) != NULL) {
+			pc->accessed = true;
+			hit_cnt++;
+			lock_release (&pc_lock);
+			return page;
+		}
+		break;
+	}
+
+	/* Read it in without holding the lock. */
+	pc->busy = true;
+	pc->accessed = true;
+	miss_cnt++;
+	pc_owner->spt.fault_cnt++;
+	lock_release (&pc_lock);
+
+	if (vm_claim_frame (page) == NULL) {
+		lock_acquire (&map_lock);
+		if (!pc->evicted) {
+			list_push_back (&evicted, &pc->evicted_elem);
+			pc->evicted = true;
+		}
+		lock_release (&map_lock);
+		page = NULL;
+	}
+
+	lock_acquire (&pc_lock);
+	pc->busy = false;
+	cond_broadcast (&pc_ready, &pc_lock);
+	lock_release (&pc_lock);
+	return page;
+}
+
+/* Reads SIZE bytes at OFFSET in INODE into BUFFER through the page
+ * cache, like inode_read_at().  Until the page cache is up, reads
+ * INODE directly. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+
+	if (pc_owner == NULL)
+		return inode_read_direct (inode, buffer, size, offset);
+
+	while (size > 0) {
+		/* Page to read, starting byte offset within page. */
+		off_t page_ofs = offset % PGSIZE;
+		struct page *page;
+
+		/* Bytes left in inode, bytes left in page, lesser of the two. */
+		off_t inode_left = inode_length (inode) - offset;
+		off_t page_left = PGSIZE - page_ofs;
+		off_t min_left = inode_left < page_left ? inode_left : page_left;
+
+		/* Number of bytes to actually copy out of this page. */
+		off_t chunk_size = size < min_left ? size : min_left;
+		if (chunk_size <= 0)
+			break;
+
+		page = pc_get (inode, offset - page_ofs);
+		if (page == NULL)
+			break;
+		memcpy (buffer + bytes_read, (uint8_t *) page->frame->kva + page_ofs,
+				chunk_size);
+		vm_unpin_frame (page);
+
+		/* Advance. */
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_read += chunk_size;
+	}
+	return bytes_read;
+}
+
+/* Copies the SIZE bytes in BUFFER, just written to INODE at OFFSET,
+ * into the cached pages that hold them.  Pages that are not cached
+ * are left alone. */
+void
+page_cache_update (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	struct page_cache key;
+
+	if (pc_owner == NULL || size <= 0)
+		return;
+
+	key.inode = inode;
+	lock_acquire (&pc_lock);
+	while (size > 0) {
+		off_t page_ofs = offset % PGSIZE;
+		off_t chunk_size = size < PGSIZE - page_ofs ? size : PGSIZE - page_ofs;
+		struct hash_elem *e;
+
+		key.ofs = offset - page_ofs;
+		e = hash_find (&pc_table, &key.elem);
+		if (e != NULL) {
+			struct page_cache *pc = hash_entry (e, struct page_cache, elem);
+			struct page *page = pc_page (pc);
+			void *kva;
+
+			/* A page being read in may have missed the new data. */
+			if (pc->busy) {
+				cond_wait (&pc_ready, &pc_lock);
+				continue;
+			}
+			kva = vm_pin_frame (page);
+			if (kva != NULL) {
+				memcpy ((uint8_t *) kva + page_ofs, buffer, chunk_size);
+				pc->accessed = true;
+				vm_unpin_frame (page);
+			}
+		}
+
+		size -= chunk_size;
+		offset += chunk_size;
+		buffer += chunk_size;
+	}
+	lock_release (&pc_lock);
+}
+
+/* Maps MAPPER, a page of a file mapping of the current process, to the
+ * cached page at OFS in INODE, read-only unless WRITABLE.  Returns
+ * false if the page cannot be read in or mapped. */
+bool
+page_cache_map (struct page *mapper, struct inode *inode, off_t ofs,
+		bool writable) {
+	struct page *page = pc_get (inode, ofs);
+	bool success;
+
+	if (page == NULL)
+		return false;
+
+	lock_acquire (&map_lock);
+	ASSERT (mapper->file.cache == NULL);
+	success = pml4_set_page (mapper->owner->pml4, mapper->va,
+			page->frame->kva, writable);
+	if (success) {
+		mapper->file.cache = page;
+		list_push_back (&page->page_cache.mappers, &mapper->file.cache_elem);
+	}
+	lock_release (&map_lock);
+
+	vm_unpin_frame (page);
+	return success;
+}
+
+/* Removes MAPPER's mapping of a cached page, if it has one.  Changes
+ * made through the mapping stay in the page cache, to be written back
+ * later. */
+void
+page_cache_unmap (struct page *mapper) {
+	lock_acquire (&map_lock);
+	if (mapper->file.cache != NULL)
+		unmap (mapper);
+	lock_release (&map_lock);
+}
+
+/* Returns true if cached page PAGE was used since the previous call,
+ * through read(), write() or any mapping, and clears the accessed
+ * bits.  Called by the clock with the frame table locked. */
+bool
+page_cache_referenced (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	struct list_elem *e;
+	bool accessed = pc->accessed;
+
+	pc->accessed = false;
+	lock_acquire (&map_lock);
+	for (e = list_begin (&pc->mappers); e != list_end (&pc->mappers);
+			e = list_next (e)) {
+		struct page *mapper = list_entry (e, struct page, file.cache_elem);
+		uint64_t *pml4 = mapper->owner->pml4;
+
+		if (pml4_is_accessed (pml4, mapper->va)) {
+			pml4_set_accessed (pml4, mapper->va, false);
+			accessed = true;
+		}
+	}
+	lock_release (&map_lock);
+	return accessed;
+}
+
+/* Returns false if a mapper of cached page PAGE is locked in memory
+ * by mlock(), which keeps PAGE resident too.  Called with the frame
+ * table locked. */
+bool
+page_cache_evictable (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	struct list_elem *e;
+	bool evictable = true;
+
+	lock_acquire (&map_lock);
+	for (e = list_begin (&pc->mappers); e != list_end (&pc->mappers);
+			e = list_next (e))
+		if (list_entry (e, struct page, file.cache_elem)->locked) {
+			evictable = false;
+			break;
+		}
+	lock_release (&map_lock);
+	return evictable;
+}
+
+/* Adds PC to LIST, marked BUSY and with its frame pinned, if it is
+ * resident and was written through a mapping.  Returns true if it
+ * was added.  Must be called with PC_LOCK held, on a page that is not
+ * BUSY. */
+static bool
+claim_dirty (struct page_cache *pc, struct list *list) {
+	struct page *page = pc_page (pc);
+	bool dirty;
+
+	ASSERT (!pc->busy);
+
+	if (vm_pin_frame (page) == NULL)
+		return false;
+	lock_acquire (&map_lock);
+	dirty = take_dirty (pc);
+	lock_release (&map_lock);
+	if (!dirty) {
+		vm_unpin_frame (page);
+		return false;
+	}
+	pc->busy = true;
+	list_push_back (list, &pc->writeback_elem);
+	return true;
+}
+
+/* Writes back the pages in LIST, from claim_dirty(), and unpins them.
+ * They stay BUSY.  Must be called without PC_LOCK. */
+static void
+write_list (struct list *list) {
+	struct list_elem *e;
+
+	for (e = list_begin (list); e != list_end (list); e = list_next (e)) {
+		struct page_cache *pc = list_entry (e, struct page_cache,
+				writeback_elem);
+		struct page *page = pc_page (pc);
+
+		write_page (page, page->frame->kva);
+		vm_unpin_frame (page);
+	}
+}
+
+/* Removes every cached page of INODE, which is about to be freed,
+ * after writing back those written through a mapping if WRITE_BACK is
+ * true.  No page of INODE may be mapped. */
+void
+page_cache_drop (struct inode *inode, bool write_back) {
+	struct page_cache key;
+	off_t length = inode_length (inode);
+	struct list dirty;
+
+	if (pc_owner == NULL)
+		return;
+
+	list_init (&dirty);
+	key.inode = inode;
+	lock_acquire (&pc_lock);
+	for (key.ofs = 0; key.ofs < length; ) {
+		struct hash_elem *e = hash_find (&pc_table, &key.elem);
+
+		if (e != NULL) {
+			struct page_cache *pc = hash_entry (e, struct page_cache, elem);
+
+			/* Being written back by page_cache_flush(). */
+			if (pc->busy) {
+				cond_wait (&pc_ready, &pc_lock);
+				continue;
+			}
+			if (!write_back || !claim_dirty (pc, &dirty))
+				pc_free (pc);
+		}
+		key.ofs += PGSIZE;
+	}
+	lock_release (&pc_lock);
+
+	if (list_empty (&dirty))
+		return;
+	write_list (&dirty);
+
+	lock_acquire (&pc_lock);
+	while (!list_empty (&dirty)) {
+		struct page_cache *pc = list_entry (list_pop_front (&dirty),
+				struct page_cache, writeback_elem);
+
+		pc->busy = false;
+		pc_free (pc);
+	}
+	lock_release (&pc_lock);
+}
+
+/* Writes back every cached page written through a mapping. */
+void
+page_cache_flush (void) {
+	struct hash_iterator i;
+	struct list dirty;
+
+	if (pc_owner == NULL)
+		return;
+
+	list_init (&dirty);
+	lock_acquire (&pc_lock);
+	free_evicted ();
+	hash_first (&i, &pc_table);
+	while (hash_next (&i)) {
+		struct page_cache *pc = hash_entry (hash_cur (&i), struct page_cache,
+				elem);
+
+		if (!pc->busy)
+			claim_dirty (pc, &dirty);
+	}
+	lock_release (&pc_lock);
+
+	if (list_empty (&dirty))
+		return;
+	write_list (&dirty);
+
+	lock_acquire (&pc_lock);
+	while (!list_empty (&dirty)) {
+		struct page_cache *pc = list_entry (list_pop_front (&dirty),
+				struct page_cache, writeback_elem);
+
+		pc->busy = false;
+	}
+	cond_broadcast (&pc_ready, &pc_lock);
+	lock_release (&pc_lock);
+}
+
+/* Prints page cache statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Page cache: %zu pages, %"PRIu64" hits, %"PRIu64" misses, "
+			"%"PRIu64" written back\n",
+			page_cnt, hit_cnt, miss_cnt, writeback_cnt);
 }
 
 /* Worker thread for page cache */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *started) {
+	/* The cached pages are charged to this thread. */
+	supplemental_page_table_init (&thread_current ()->spt);
+	pc_owner = thread_current ();
+	sema_up (started);
+
+	for (;;) {
+		timer_sleep (WRITEBACK_INTERVAL);
+		page_cache_flush ();
+	}
 }
+#endif /* EFILESYS */
@@ -34,5 +34,22 @@ void fat_remove_chain (
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
+cluster_t sector_to_cluster (disk_sector_t sector);
+
+/* The clusters of one chain, in order, as far as they have been
+ * looked up, so that finding the N'th cluster of a file walks the
+ * FAT only once. */
+struct fat_chain {
+	cluster_t start;        /* First cluster, or 0 for an empty chain. */
+	cluster_t *clusters;    /* Clusters 0...CNT-1 of the chain. */
+	size_t cnt;             /* Number of clusters known. */
+	size_t capacity;        /* Number of elements in CLUSTERS. */
+};
+
+void fat_chain_init (struct fat_chain *, cluster_t start);
+cluster_t fat_chain_get (struct fat_chain *, size_t idx);
+cluster_t fat_chain_append (struct fat_chain *);
+void fat_chain_truncate (struct fat_chain *, size_t cnt);
+void fat_chain_destroy (struct fat_chain *);
 
 #endif /* filesys/fat.h */
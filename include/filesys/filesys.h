@@ -4,7 +4,8 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 
-/* Sectors of system file inodes. */
+/* Sectors of system file inodes.  With EFILESYS there is no free map
+ * file, and the root directory's inode is in ROOT_DIR_CLUSTER. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
 
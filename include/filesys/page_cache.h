@@ -1,12 +1,41 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
 
 struct page;
+struct inode;
 enum vm_type;
 
-struct page_cache {};
+/* A page of file data in the page cache.  Its frame is in the frame
+ * table, owned by the page cache's thread, and is evicted by the same
+ * clock as user pages. */
+struct page_cache {
+	struct inode *inode;        /* File. */
+	off_t ofs;                  /* Page-aligned offset in INODE. */
+	bool busy;                  /* Being read in or written back. */
+	bool accessed;              /* Read or written since the clock passed. */
+	bool dirty;                 /* Written through a mapping. */
+	bool evicted;               /* In the list of evicted pages. */
+	struct list mappers;        /* File pages mapping the frame. */
+	struct hash_elem elem;      /* Element in the cache. */
+	struct list_elem evicted_elem;
+	struct list_elem writeback_elem;  /* Element in a list to write back. */
+};
 
-void page_cache_init (void);
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+off_t page_cache_read (struct inode *, void *, off_t size, off_t offset);
+void page_cache_update (struct inode *, const void *, off_t size,
+		off_t offset);
+bool page_cache_map (struct page *mapper, struct inode *, off_t ofs,
+		bool writable);
+void page_cache_unmap (struct page *mapper);
+bool page_cache_referenced (struct page *page);
+bool page_cache_evictable (struct page *page);
+void page_cache_drop (struct inode *, bool write_back);
+void page_cache_flush (void);
+void page_cache_print_stats (void);
 #endif
@@ -0,0 +1,33 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* Fast LZ77 compression.
+ *
+ * A byte-oriented codec in the style of LZ4, meant for blocks of a
+ * few kilobytes such as memory pages: it favors speed over ratio and
+ * needs no memory besides LZ_WORK_SIZE bytes of scratch space, which
+ * the caller provides since kernel stacks are too small for it.
+ *
+ * A compressed block is a series of sequences, each a token byte whose
+ * high and low nibbles give a literal length and a match length less
+ * LZ_MIN_MATCH, the literals, a 16-bit little-endian offset back into
+ * the output, and extra length bytes for nibbles of 15.  The last
+ * sequence has literals only. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shortest match encoded. */
+#define LZ_MIN_MATCH 4
+
+/* Bytes of scratch space lz_compress() needs. */
+#define LZ_HASH_BITS 10
+#define LZ_WORK_SIZE ((1 << LZ_HASH_BITS) * sizeof (uint16_t))
+
+size_t lz_compress (const void *src, size_t src_len,
+		void *dst, size_t dst_cap, void *work);
+bool lz_decompress (const void *src, size_t src_len,
+		void *dst, size_t dst_len);
+
+#endif /* lib/kernel/lz.h */
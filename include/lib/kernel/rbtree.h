@@ -0,0 +1,80 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * An ordered set with O(log n) insertion, removal and search.  Like
+ * the list and hash table, it does not allocate memory: each
+ * structure that can be in a tree embeds a `struct rb_elem', and
+ * rb_entry() converts an element back into its enclosing structure.
+ *
+ * Besides exact lookups, the tree answers ordered queries such as
+ * "the first element not less than KEY" (rb_lower_bound()) and "the
+ * last element not greater than KEY" (rb_floor()), which is what
+ * range structures like address-space maps and free-extent indexes
+ * need.  KEY is an element, usually a stack-allocated dummy of the
+ * enclosing structure with only the compared fields filled in. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem {
+	struct rb_elem *parent;     /* Parent, or NULL at the root. */
+	struct rb_elem *left;       /* Left (lesser) child. */
+	struct rb_elem *right;      /* Right (greater) child. */
+	bool red;                   /* Node color. */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to
+ * the structure that RB_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                   \
+	((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent         \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+		const struct rb_elem *b, void *aux);
+
+/* Performs some operation on tree element E, given auxiliary
+ * data AUX. */
+typedef void rb_action_func (struct rb_elem *e, void *aux);
+
+/* Tree. */
+struct rb_tree {
+	struct rb_elem *root;       /* Root, or NULL if empty. */
+	size_t elem_cnt;            /* Number of elements. */
+	rb_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+void rb_clear (struct rb_tree *, rb_action_func *);
+
+/* Insertion and removal. */
+struct rb_elem *rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+
+/* Search. */
+struct rb_elem *rb_find (struct rb_tree *, const struct rb_elem *key);
+struct rb_elem *rb_lower_bound (struct rb_tree *, const struct rb_elem *key);
+struct rb_elem *rb_upper_bound (struct rb_tree *, const struct rb_elem *key);
+struct rb_elem *rb_floor (struct rb_tree *, const struct rb_elem *key);
+
+/* In-order traversal.  rb_next() of the last element and
+ * rb_prev() of the first return NULL. */
+struct rb_elem *rb_first (struct rb_tree *);
+struct rb_elem *rb_last (struct rb_tree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+/* Properties. */
+size_t rb_size (struct rb_tree *);
+bool rb_empty (struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -36,6 +36,32 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Virtual memory statistics. */
+	SYS_MEMSTAT,                /* Report the caller's memory usage. */
+	SYS_MADVISE,                /* Give advice about memory use. */
+	SYS_MLOCK,                  /* Lock pages in memory. */
+	SYS_MUNLOCK,                /* Unlock pages. */
+
+	/* File system. */
+	SYS_FSYNC,                  /* Write a file's data to disk. */
+};
+
+/* Items reported by SYS_MEMSTAT. */
+enum {
+	MEMSTAT_RSS,                /* Resident pages. */
+	MEMSTAT_WSS,                /* Resident pages in the working set. */
+	MEMSTAT_FAULTS,             /* Page faults taken. */
+	MEMSTAT_REFS,               /* References seen by page replacement. */
+};
+
+/* Advice for SYS_MADVISE. */
+enum {
+	MADV_NORMAL,                /* No particular access pattern. */
+	MADV_RANDOM,                /* Random access: read no more than asked. */
+	MADV_SEQUENTIAL,            /* Sequential access: read ahead. */
+	MADV_WILLNEED,              /* Will be used soon: read in now. */
+	MADV_DONTNEED,              /* Not needed for now: page out now. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -11,13 +11,23 @@ enum palloc_flags {
 	PAL_USER = 004              /* User page. */
 };
 
+/* Number of page colours, for a 1 MB, 16-way set-associative
+   physically indexed cache: one way spans 16 pages. */
+#define PALLOC_COLOR_CNT 16
+
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
 uint64_t palloc_init (void);
+void palloc_init_colors (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_multiple_aligned (enum palloc_flags, size_t page_cnt,
+		size_t align_cnt);
+void *palloc_get_page_colored (enum palloc_flags, size_t color);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+size_t palloc_free_cnt (enum palloc_flags);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,37 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Optional constructor run once on each object when its slab is
+ * created.  Objects given back with slab_free() are expected to be
+ * returned to their constructed state by the caller. */
+typedef void slab_ctor_func (void *obj);
+
+/* A cache of fixed-size objects carved out of whole pages. */
+struct slab_cache {
+	const char *name;           /* Name reported by slab_print_stats(). */
+	size_t obj_size;            /* Size of each object in bytes. */
+	size_t objs_per_slab;       /* Number of objects in one slab. */
+	size_t obj_ofs;             /* Offset of the first object in a slab. */
+	slab_ctor_func *ctor;       /* Constructor, or NULL. */
+
+	struct lock lock;           /* Protects the members below. */
+	struct list partial;        /* Slabs with at least one free object. */
+	size_t slab_cnt;            /* Slabs (pages) owned by the cache. */
+	size_t in_use;              /* Objects handed out. */
+	size_t alloc_cnt;           /* Total slab_alloc() calls served. */
+
+	struct list_elem elem;      /* Element in the list of all caches. */
+};
+
+void slab_init (void);
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+		slab_ctor_func *ctor);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
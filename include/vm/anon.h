@@ -1,13 +1,24 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include <stddef.h>
 struct page;
 enum vm_type;
+struct ksm_frame;
+struct zswap_entry;
+
+/* Swap slot value of a page that is not on the swap disk. */
+#define SWAP_SLOT_NONE ((size_t) -1)
 
 struct anon_page {
+	size_t swap_slot;        /* Slot holding the page, or SWAP_SLOT_NONE. */
+	struct ksm_frame *shared;   /* Merged frame mapped read-only, or NULL. */
+	struct zswap_entry *zswap;  /* Compressed copy in zswap, or NULL. */
 };
 
 void vm_anon_init (void);
+void vm_anon_print_stats (void);
+size_t anon_reserve_slots (size_t cnt);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
 
 #endif
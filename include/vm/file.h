@@ -6,7 +6,24 @@
 struct page;
 enum vm_type;
 
+/* Where the contents of a lazily loaded page come from.  Used as the
+ * `aux' of executable segments and mmap pages until their first fault. */
+struct lazy_aux {
+	struct file *file;       /* File to read from. */
+	off_t ofs;               /* Offset of the page in FILE. */
+	size_t read_bytes;       /* Bytes to read; the rest is zero-filled. */
+	size_t zero_bytes;       /* PGSIZE - READ_BYTES. */
+};
+
 struct file_page {
+	struct file *file;       /* Backing file, owned by the vm_area. */
+	off_t ofs;               /* Offset of the page in FILE. */
+	size_t read_bytes;       /* Bytes of FILE backing this page. */
+	size_t zero_bytes;       /* Trailing bytes past the end of FILE. */
+#ifdef EFILESYS
+	struct page *cache;      /* Page cache page mapped, or NULL. */
+	struct list_elem cache_elem;  /* Element in its mappers. */
+#endif
 };
 
 void vm_file_init (void);
@@ -14,4 +31,8 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+#ifdef EFILESYS
+bool file_backed_cached (struct page *page);
+bool file_backed_map (struct page *page);
+#endif
 #endif
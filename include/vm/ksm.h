@@ -0,0 +1,23 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <hash.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A read-only frame whose contents are shared by several anonymous
+ * pages that happened to hold identical data. */
+struct ksm_frame {
+	void *kva;                  /* The shared contents. */
+	uint64_t checksum;          /* hash_bytes() of the contents. */
+	size_t ref_cnt;             /* Pages mapping this frame. */
+	struct hash_elem elem;      /* Element in the stable table. */
+};
+
+/* Frames examined per ksmd pass; 0 disables merging. */
+extern size_t ksm_pages_to_scan;
+
+void ksm_init (void);
+void ksm_put (struct ksm_frame *);
+void ksm_print_stats (void);
+
+#endif  /* VM_KSM_H */
@@ -0,0 +1,8 @@
+#ifndef VM_KSWAPD_H
+#define VM_KSWAPD_H
+
+void kswapd_init (void);
+void kswapd_poke (void);
+void kswapd_print_stats (void);
+
+#endif  /* VM_KSWAPD_H */
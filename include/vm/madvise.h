@@ -0,0 +1,9 @@
+#ifndef VM_MADVISE_H
+#define VM_MADVISE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+int do_madvise (void *addr, size_t length, int advice);
+int do_mlock (void *addr, size_t length, bool lock);
+
+#endif  /* VM_MADVISE_H */
@@ -0,0 +1,33 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct page;
+struct inode;
+struct file;
+
+/* A read-only page of an executable, loaded once and mapped by every
+ * process running it. */
+struct text_frame {
+	struct inode *inode;        /* Executable. */
+	off_t ofs;                  /* Offset of the page in INODE. */
+	size_t read_bytes;          /* Bytes read; the rest is zero. */
+	void *kva;                  /* The contents. */
+	size_t ref_cnt;             /* Pages mapping this frame. */
+	struct hash_elem elem;      /* Element in the text table. */
+};
+
+struct text_page {
+	struct text_frame *shared;  /* Frame mapped read-only. */
+};
+
+void vm_text_init (void);
+bool text_claim (struct page *page);
+bool text_claim_loaded (struct page *page, void *kva);
+bool text_cached (struct file *file, off_t ofs, size_t read_bytes);
+void text_print_stats (void);
+
+#endif  /* VM_TEXT_H */
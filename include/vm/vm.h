@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include "threads/palloc.h"
 #include <hash.h>
+#include <list.h>
+#include <rbtree.h>
 
 enum vm_type {
 	/* page not initialized */
@@ -13,6 +15,8 @@ enum vm_type {
 	VM_FILE = 2,
 	/* page that hold the page cache, for project 4 */
 	VM_PAGE_CACHE = 3,
+	/* read-only page of an executable, shared between processes */
+	VM_TEXT = 4,
 
 	/* Bit flags to store state */
 
@@ -28,6 +32,8 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/vma.h"
+#include "vm/text.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -47,10 +53,12 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
-	// int present;
-	// int writable;
-	// void *swap_addr;
+	bool writable;         /* Whether the user may write to the page. */
+	struct thread *owner;  /* Thread whose pml4 maps this page. */
+	bool zero_mapped;      /* Mapped read-only to the shared zero frame. */
+	bool locked;           /* Kept resident by mlock(). */
 	struct hash_elem hash_elem;
+	struct list_elem vma_elem;  /* Element in the owning vm_area's pages. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -58,6 +66,7 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
+		struct text_page text;
 #ifdef EFILESYS
 		struct page_cache page_cache;
 #endif
@@ -68,6 +77,10 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list_elem frame_elem;   /* Element in the frame table. */
+	uint64_t ref_stamp;            /* Owner's fault_cnt at last reference. */
+	unsigned pin_cnt;              /* Pins held for kernel I/O. */
+	bool evicting;                 /* Page being written out? */
 };
 
 /* The function table for page operations.
@@ -90,7 +103,15 @@ struct page_operations {
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
-	struct hash hash_table;
+	struct hash hash_table;        /* Materialized pages, by address. */
+	struct rb_tree vmas;           /* Address space layout (struct vm_area). */
+
+	/* Resident set accounting, under the frame table lock except for
+	 * FAULT_CNT, which only the owner updates. */
+	size_t rss;                    /* Frames in the frame table. */
+	size_t peak_rss;               /* Highest RSS so far. */
+	uint64_t fault_cnt;            /* Page faults handled. */
+	uint64_t ref_cnt;              /* Accessed bits found by the clock. */
 };
 
 #include "threads/thread.h"
@@ -113,7 +134,30 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+size_t vm_prefetch (void *va, size_t cnt);
+void vm_page_out (struct page *page);
+bool vm_lock_page (struct page *page);
+void vm_unlock_page (struct page *page);
+bool vm_pin_buffer (const void *buffer, size_t size, bool write);
+void vm_unpin_buffer (const void *buffer, size_t size);
+struct frame *vm_detach_frame (struct page *page);
+void vm_free_frame (struct frame *frame);
+void *vm_claim_frame (struct page *page);
+void *vm_pin_frame (struct page *page);
+void vm_unpin_frame (struct page *page);
+
+/* Visitor for vm_scan_frames(), called with the frame table locked. */
+typedef void vm_frame_visitor (struct frame *frame, void *aux);
+void vm_scan_frames (size_t cnt, vm_frame_visitor *visit, void *aux);
+void *vm_steal_frame (struct frame *frame);
+
+/* Most frames vm_reclaim() evicts in one batch. */
+#define VM_RECLAIM_MAX 32
+size_t vm_reclaim (size_t cnt);
 enum vm_type page_get_type (struct page *page);
+int64_t vm_memstat (int item);
+void vm_record_exit (struct supplemental_page_table *spt);
+void vm_print_stats (void);
 struct page *page_lookup (struct hash *h UNUSED, const void *address);
 
 #endif  /* VM_VM_H */
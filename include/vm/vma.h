@@ -0,0 +1,45 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <list.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "vm/vm.h"
+
+struct file;
+struct supplemental_page_table;
+
+/* A virtual memory area: a run of pages with the same type, protection
+ * and backing.  Areas are kept in an ordered tree per process; the
+ * `struct page' for an address inside an area is only created when it
+ * is first faulted, so large sparse mappings cost one record. */
+struct vm_area {
+	void *start;                /* First page of the area. */
+	void *end;                  /* One past the last page. */
+	enum vm_type type;          /* Type of the pages, with markers. */
+	bool writable;              /* Whether the user may write the pages. */
+	vm_initializer *init;       /* Fills a page on its first fault. */
+	struct file *file;          /* Backing file (own reference), or NULL. */
+	off_t ofs;                  /* Offset of START in FILE. */
+	size_t read_bytes;          /* Bytes of FILE from START; rest is zero. */
+	int advice;                 /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+	struct list pages;          /* Materialized pages (page->vma_elem). */
+	struct rb_elem elem;        /* Element in spt->vmas. */
+};
+
+void vma_init (struct supplemental_page_table *spt);
+struct vm_area *vma_map (struct supplemental_page_table *spt,
+		enum vm_type type, void *start, size_t page_cnt, bool writable,
+		struct file *file, off_t ofs, size_t read_bytes, vm_initializer *init);
+void vma_unmap (struct supplemental_page_table *spt, struct vm_area *vma);
+struct vm_area *vma_find (struct supplemental_page_table *spt,
+		const void *va);
+bool vma_overlaps (struct supplemental_page_table *spt,
+		const void *start, const void *end);
+struct page *vma_populate (struct vm_area *vma, void *va);
+bool vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src);
+void vma_kill (struct supplemental_page_table *spt);
+
+#endif /* vm/vma.h */
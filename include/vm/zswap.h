@@ -0,0 +1,13 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+
+struct zswap_entry;
+
+void zswap_init (void);
+struct zswap_entry *zswap_store (const void *kva);
+void zswap_load (struct zswap_entry *, void *kva);
+void zswap_free (struct zswap_entry *);
+void zswap_print_stats (void);
+
+#endif  /* VM_ZSWAP_H */
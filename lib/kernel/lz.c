@@ -0,0 +1,169 @@
+/* Fast LZ77 compression.
+
+   See lz.h for the block format.  The compressor finds matches
+   through a hash table of the positions of recent 4-byte strings,
+   keeping only the latest position per bucket, so it never searches
+   and runs in linear time.  Blocks are at most 64 kB, so that offsets
+   and positions fit in 16 bits. */
+
+#include "lz.h"
+#include <string.h>
+#include "../debug.h"
+
+/* Output position while compressing. */
+struct lz_out {
+	uint8_t *p;                 /* Next byte to write. */
+	uint8_t *end;               /* End of the output buffer. */
+};
+
+/* Returns the 4 bytes at P as an integer. */
+static inline uint32_t
+read32 (const uint8_t *p) {
+	uint32_t v;
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Returns the hash table bucket for the 4 bytes V. */
+static inline size_t
+lz_hash (uint32_t v) {
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the extra bytes of a length LEN whose nibble was 15.
+   Returns false if OUT is full. */
+static bool
+put_length (struct lz_out *out, size_t len) {
+	for (; len >= 255; len -= 255) {
+		if (out->p == out->end)
+			return false;
+		*out->p++ = 255;
+	}
+	if (out->p == out->end)
+		return false;
+	*out->p++ = len;
+	return true;
+}
+
+/* Writes a sequence of the LIT_LEN literals at LIT followed, if
+   MATCH_LEN is nonzero, by a match of MATCH_LEN bytes OFFSET bytes
+   back.  Returns false if OUT is full. */
+static bool
+put_sequence (struct lz_out *out, const uint8_t *lit, size_t lit_len,
+		size_t offset, size_t match_len) {
+	size_t m = match_len != 0 ? match_len - LZ_MIN_MATCH : 0;
+
+	if (out->p == out->end)
+		return false;
+	*out->p++ = (lit_len < 15 ? lit_len : 15) << 4 | (m < 15 ? m : 15);
+	if (lit_len >= 15 && !put_length (out, lit_len - 15))
+		return false;
+	if ((size_t) (out->end - out->p) < lit_len)
+		return false;
+	memcpy (out->p, lit, lit_len);
+	out->p += lit_len;
+
+	if (match_len == 0)
+		return true;
+	if (out->end - out->p < 2)
+		return false;
+	*out->p++ = offset & 0xff;
+	*out->p++ = offset >> 8;
+	return m < 15 || put_length (out, m - 15);
+}
+
+/* Compresses the SRC_LEN bytes at SRC into the DST_CAP bytes at DST,
+   using the LZ_WORK_SIZE bytes at WORK as scratch space.  Returns the
+   compressed size, or 0 if it would exceed DST_CAP. */
+size_t
+lz_compress (const void *src_, size_t src_len,
+		void *dst, size_t dst_cap, void *work) {
+	const uint8_t *src = src_;
+	uint16_t *table = work;
+	struct lz_out out = { .p = dst, .end = (uint8_t *) dst + dst_cap };
+	size_t ip = 0, anchor = 0;
+
+	ASSERT (src_len <= UINT16_MAX);
+
+	/* Position + 1 of the last string of each bucket; 0 if none. */
+	memset (table, 0, LZ_WORK_SIZE);
+	while (ip + LZ_MIN_MATCH <= src_len) {
+		uint32_t v = read32 (src + ip);
+		size_t h = lz_hash (v);
+		size_t ref = table[h];
+
+		table[h] = ip + 1;
+		if (ref == 0 || read32 (src + ref - 1) != v) {
+			ip++;
+			continue;
+		}
+		ref--;
+
+		size_t len = LZ_MIN_MATCH;
+		while (ip + len < src_len && src[ref + len] == src[ip + len])
+			len++;
+		if (!put_sequence (&out, src + anchor, ip - anchor, ip - ref, len))
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (!put_sequence (&out, src + anchor, src_len - anchor, 0, 0))
+		return 0;
+	return out.p - (uint8_t *) dst;
+}
+
+/* Reads the extra bytes of a length whose nibble was 15 from *P,
+   which must stay below END, and adds them to *LEN.  Returns false
+   if the input ends first. */
+static bool
+get_length (const uint8_t **p, const uint8_t *end, size_t *len) {
+	uint8_t b;
+
+	do {
+		if (*p == end)
+			return false;
+		b = *(*p)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC into the DST_LEN bytes at
+   DST.  Returns true if SRC is a valid block that decompresses to
+   exactly DST_LEN bytes. */
+bool
+lz_decompress (const void *src, size_t src_len, void *dst_, size_t dst_len) {
+	const uint8_t *p = src, *end = p + src_len;
+	uint8_t *dst = dst_;
+	size_t op = 0;
+
+	while (p < end) {
+		uint8_t token = *p++;
+		size_t lit_len = token >> 4, len = token & 15, offset;
+
+		if (lit_len == 15 && !get_length (&p, end, &lit_len))
+			return false;
+		if (lit_len > (size_t) (end - p) || lit_len > dst_len - op)
+			return false;
+		memcpy (dst + op, p, lit_len);
+		p += lit_len;
+		op += lit_len;
+		if (p == end)
+			break;
+
+		if (end - p < 2)
+			return false;
+		offset = p[0] | p[1] << 8;
+		p += 2;
+		if (len == 15 && !get_length (&p, end, &len))
+			return false;
+		len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || len > dst_len - op)
+			return false;
+
+		/* Byte by byte, since the match may overlap its own output. */
+		for (; len > 0; len--, op++)
+			dst[op] = dst[op - offset];
+	}
+	return op == dst_len;
+}
@@ -0,0 +1,407 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.  The algorithms follow
+   Cormen et al., "Introduction to Algorithms", chapter 13, with
+   null pointers standing in for the black sentinel leaves. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+		struct rb_elem *parent);
+static struct rb_elem *subtree_min (struct rb_elem *);
+static struct rb_elem *subtree_max (struct rb_elem *);
+
+static inline bool
+is_red (const struct rb_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (less != NULL);
+
+	t->root = NULL;
+	t->elem_cnt = 0;
+	t->less = less;
+	t->aux = aux;
+}
+
+/* Removes all the elements from T.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the tree, children before parents, and may deallocate the
+   memory used by the element.  Modifying T from DESTRUCTOR
+   yields undefined behavior. */
+void
+rb_clear (struct rb_tree *t, rb_action_func *destructor) {
+	struct rb_elem *e = t->root;
+
+	while (e != NULL) {
+		if (e->left != NULL)
+			e = e->left;
+		else if (e->right != NULL)
+			e = e->right;
+		else {
+			struct rb_elem *parent = e->parent;
+			if (parent != NULL) {
+				if (parent->left == e)
+					parent->left = NULL;
+				else
+					parent->right = NULL;
+			}
+			if (destructor != NULL)
+				destructor (e, t->aux);
+			e = parent;
+		}
+	}
+	t->root = NULL;
+	t->elem_cnt = 0;
+}
+
+/* Inserts NEW into T and returns a null pointer, if no equal
+   element is already in the tree.
+   If an equal element is already in the tree, returns it
+   without inserting NEW. */
+struct rb_elem *
+rb_insert (struct rb_tree *t, struct rb_elem *new) {
+	struct rb_elem *parent = NULL;
+	struct rb_elem **link = &t->root;
+
+	while (*link != NULL) {
+		parent = *link;
+		if (t->less (new, parent, t->aux))
+			link = &parent->left;
+		else if (t->less (parent, new, t->aux))
+			link = &parent->right;
+		else
+			return parent;
+	}
+
+	new->parent = parent;
+	new->left = new->right = NULL;
+	new->red = true;
+	*link = new;
+	insert_fixup (t, new);
+	t->elem_cnt++;
+	return NULL;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e) {
+	struct rb_elem *y, *x, *x_parent;
+	bool y_red;
+
+	ASSERT (t->elem_cnt > 0);
+
+	/* Y is the node that is actually spliced out: E itself if it
+	   has at most one child, otherwise its in-order successor. */
+	y = (e->left == NULL || e->right == NULL) ? e : subtree_min (e->right);
+	x = y->left != NULL ? y->left : y->right;
+	x_parent = y->parent;
+	y_red = y->red;
+
+	if (x != NULL)
+		x->parent = y->parent;
+	if (y->parent == NULL)
+		t->root = x;
+	else if (y == y->parent->left)
+		y->parent->left = x;
+	else
+		y->parent->right = x;
+
+	if (y != e) {
+		/* Put Y in E's place, taking over its color. */
+		if (x_parent == e)
+			x_parent = y;
+		y->parent = e->parent;
+		y->left = e->left;
+		y->right = e->right;
+		y->red = e->red;
+		if (e->parent == NULL)
+			t->root = y;
+		else if (e == e->parent->left)
+			e->parent->left = y;
+		else
+			e->parent->right = y;
+		if (y->left != NULL)
+			y->left->parent = y;
+		if (y->right != NULL)
+			y->right->parent = y;
+	}
+
+	if (!y_red)
+		remove_fixup (t, x, x_parent);
+	t->elem_cnt--;
+}
+
+/* Finds and returns an element equal to KEY in T, or a null
+   pointer if no equal element exists in the tree. */
+struct rb_elem *
+rb_find (struct rb_tree *t, const struct rb_elem *key) {
+	struct rb_elem *e = rb_lower_bound (t, key);
+	return e != NULL && !t->less (key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the first element of T that is not less than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_lower_bound (struct rb_tree *t, const struct rb_elem *key) {
+	struct rb_elem *e = t->root, *result = NULL;
+
+	while (e != NULL)
+		if (t->less (e, key, t->aux))
+			e = e->right;
+		else {
+			result = e;
+			e = e->left;
+		}
+	return result;
+}
+
+/* Returns the first element of T that is greater than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_upper_bound (struct rb_tree *t, const struct rb_elem *key) {
+	struct rb_elem *e = t->root, *result = NULL;
+
+	while (e != NULL)
+		if (t->less (key, e, t->aux)) {
+			result = e;
+			e = e->left;
+		} else
+			e = e->right;
+	return result;
+}
+
+/* Returns the last element of T that is not greater than KEY, or
+   a null pointer if there is none. */
+struct rb_elem *
+rb_floor (struct rb_tree *t, const struct rb_elem *key) {
+	struct rb_elem *e = t->root, *result = NULL;
+
+	while (e != NULL)
+		if (t->less (key, e, t->aux))
+			e = e->left;
+		else {
+			result = e;
+			e = e->right;
+		}
+	return result;
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_first (struct rb_tree *t) {
+	return t->root != NULL ? subtree_min (t->root) : NULL;
+}
+
+/* Returns the greatest element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_last (struct rb_tree *t) {
+	return t->root != NULL ? subtree_max (t->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest element. */
+struct rb_elem *
+rb_next (struct rb_elem *e) {
+	if (e->right != NULL)
+		return subtree_min (e->right);
+	while (e->parent != NULL && e == e->parent->right)
+		e = e->parent;
+	return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the least element. */
+struct rb_elem *
+rb_prev (struct rb_elem *e) {
+	if (e->left != NULL)
+		return subtree_max (e->left);
+	while (e->parent != NULL && e == e->parent->left)
+		e = e->parent;
+	return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (struct rb_tree *t) {
+	return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+rb_empty (struct rb_tree *t) {
+	return t->elem_cnt == 0;
+}
+
+static struct rb_elem *
+subtree_min (struct rb_elem *e) {
+	while (e->left != NULL)
+		e = e->left;
+	return e;
+}
+
+static struct rb_elem *
+subtree_max (struct rb_elem *e) {
+	while (e->right != NULL)
+		e = e->right;
+	return e;
+}
+
+/* Makes X's right child Y the root of X's subtree. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x) {
+	struct rb_elem *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		t->root = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	y->left = x;
+	x->parent = y;
+}
+
+/* Makes X's left child Y the root of X's subtree. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x) {
+	struct rb_elem *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		t->root = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+	y->right = x;
+	x->parent = y;
+}
+
+/* Restores the red-black properties after red node Z was
+   linked in as a leaf. */
+static void
+insert_fixup (struct rb_tree *t, struct rb_elem *z) {
+	struct rb_elem *p;
+
+	while ((p = z->parent) != NULL && p->red) {
+		/* P is red, so it is not the root and has a parent. */
+		struct rb_elem *g = p->parent;
+
+		if (p == g->left) {
+			struct rb_elem *u = g->right;
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				z = g;
+			} else {
+				if (z == p->right) {
+					z = p;
+					rotate_left (t, z);
+					p = z->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_right (t, g);
+			}
+		} else {
+			struct rb_elem *u = g->left;
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				z = g;
+			} else {
+				if (z == p->left) {
+					z = p;
+					rotate_right (t, z);
+					p = z->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_left (t, g);
+			}
+		}
+	}
+	t->root->red = false;
+}
+
+/* Restores the red-black properties after a black node was
+   spliced out from above X, whose parent is now PARENT.  X may
+   be null, which is why PARENT is passed separately. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_elem *x, struct rb_elem *parent) {
+	while (x != t->root && !is_red (x)) {
+		if (x == parent->left) {
+			struct rb_elem *w = parent->right;
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_left (t, parent);
+				w = parent->right;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->right)) {
+					w->left->red = false;
+					w->red = true;
+					rotate_right (t, w);
+					w = parent->right;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->right->red = false;
+				rotate_left (t, parent);
+				x = t->root;
+			}
+		} else {
+			struct rb_elem *w = parent->left;
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_right (t, parent);
+				w = parent->left;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->left)) {
+					w->right->red = false;
+					w->red = true;
+					rotate_left (t, w);
+					w = parent->left;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->left->red = false;
+				rotate_right (t, parent);
+				x = t->root;
+			}
+		}
+	}
+	if (x != NULL)
+		x->red = false;
+}
@@ -0,0 +1,143 @@
+/* Grows files of assorted sizes, removes every other one to leave
+   the free space in pieces, then grows new files two at a time, so
+   that their allocations interleave and land in the holes and past
+   them.  Finally checks the contents of every file left, which would
+   show any sector handed out twice. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OLD_CNT 24
+#define NEW_CNT 12
+#define CHUNK 700
+
+static char buf[CHUNK];
+static char rbuf[CHUNK];
+
+/* Returns the size of old file I. */
+static size_t
+old_size (int i) 
+{
+  return (i % 5 + 1) * 1500;
+}
+
+/* Returns the size of new file I. */
+static size_t
+new_size (int i) 
+{
+  return (i % 3 + 1) * 2500;
+}
+
+/* Fills DST with the SIZE bytes at OFS of the contents of file ID. */
+static void
+fill (char *dst, int id, size_t ofs, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    dst[i] = id * 37 + (ofs + i) * 7;
+}
+
+/* Appends the next chunk of file ID, of SIZE bytes in all, to the
+   file open as FD, which holds *OFS bytes so far. */
+static void
+append (int fd, int id, size_t *ofs, size_t size) 
+{
+  size_t n = size - *ofs < CHUNK ? size - *ofs : CHUNK;
+
+  if (n == 0)
+    return;
+  fill (buf, id, *ofs, n);
+  if (write (fd, buf, n) != (int) n)
+    fail ("write to file %d at %zu", id, *ofs);
+  *ofs += n;
+}
+
+/* Checks that file NAME holds the SIZE bytes of file ID. */
+static void
+verify (const char *name, int id, size_t size) 
+{
+  size_t ofs;
+  int fd;
+
+  if ((fd = open (name)) < 2)
+    fail ("open \"%s\"", name);
+  if (filesize (fd) != (int) size)
+    fail ("\"%s\" has %d bytes instead of %zu", name, filesize (fd), size);
+  for (ofs = 0; ofs < size; ofs += CHUNK)
+    {
+      size_t n = size - ofs < CHUNK ? size - ofs : CHUNK;
+
+      if (read (fd, rbuf, n) != (int) n)
+        fail ("read \"%s\" at %zu", name, ofs);
+      fill (buf, id, ofs, n);
+      compare_bytes (rbuf, buf, n, ofs, name);
+    }
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  char name[16], name2[16];
+  int i;
+
+  quiet = true;
+  for (i = 0; i < OLD_CNT; i++)
+    {
+      size_t ofs = 0;
+      int fd;
+
+      snprintf (name, sizeof name, "old%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      while (ofs < old_size (i))
+        append (fd, i, &ofs, old_size (i));
+      close (fd);
+    }
+  for (i = 0; i < OLD_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "old%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+  msg ("grew %d files and removed every other one", OLD_CNT);
+
+  quiet = true;
+  for (i = 0; i < NEW_CNT; i += 2)
+    {
+      size_t ofs = 0, ofs2 = 0;
+      int fd, fd2;
+
+      snprintf (name, sizeof name, "new%d", i);
+      snprintf (name2, sizeof name2, "new%d", i + 1);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK (create (name2, 0), "create \"%s\"", name2);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      CHECK ((fd2 = open (name2)) > 1, "open \"%s\"", name2);
+      while (ofs < new_size (i) || ofs2 < new_size (i + 1))
+        {
+          append (fd, 100 + i, &ofs, new_size (i));
+          append (fd2, 100 + i + 1, &ofs2, new_size (i + 1));
+        }
+      close (fd);
+      close (fd2);
+    }
+  quiet = false;
+  msg ("grew %d files two at a time", NEW_CNT);
+
+  for (i = 1; i < OLD_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "old%d", i);
+      verify (name, i, old_size (i));
+    }
+  for (i = 0; i < NEW_CNT; i++)
+    {
+      snprintf (name, sizeof name, "new%d", i);
+      verify (name, 100 + i, new_size (i));
+    }
+  msg ("verified %d files", OLD_CNT / 2 + NEW_CNT);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(frag-reuse) begin
+(frag-reuse) grew 24 files and removed every other one
+(frag-reuse) grew 12 files two at a time
+(frag-reuse) verified 24 files
+(frag-reuse) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Grows an empty file one write at a time until it needs its
+   direct, indirect and doubly indirect sectors, checking its length
+   after every write, then writes a chunk far past the end, leaving a
+   hole, and reads the whole file back.  The hole must read as
+   zeros. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK 4096
+#define GROWN_SIZE (160 * 1024)
+#define FAR_OFS (1024 * 1024)
+
+static const char file_name[] = "grown";
+static char data[GROWN_SIZE + CHUNK];
+static char buf[CHUNK];
+static char zeros[CHUNK];
+
+void
+test_main (void) 
+{
+  size_t ofs;
+  int fd;
+
+  random_bytes (data, sizeof data);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  for (ofs = 0; ofs < GROWN_SIZE; ofs += CHUNK)
+    {
+      if (write (fd, data + ofs, CHUNK) != CHUNK)
+        fail ("write %d bytes at offset %zu", CHUNK, ofs);
+      if (filesize (fd) != (int) (ofs + CHUNK))
+        fail ("file is %d bytes after writing up to %zu",
+              filesize (fd), ofs + CHUNK);
+    }
+  msg ("grow \"%s\" to %d bytes", file_name, GROWN_SIZE);
+
+  seek (fd, FAR_OFS);
+  CHECK (write (fd, data + GROWN_SIZE, CHUNK) == CHUNK,
+         "write at offset %d", FAR_OFS);
+  CHECK (filesize (fd) == FAR_OFS + CHUNK, "check file size");
+
+  seek (fd, 0);
+  for (ofs = 0; ofs < FAR_OFS + CHUNK; ofs += CHUNK)
+    {
+      const char *expected;
+
+      if (read (fd, buf, CHUNK) != CHUNK)
+        fail ("read %d bytes at offset %zu", CHUNK, ofs);
+      if (ofs < GROWN_SIZE)
+        expected = data + ofs;
+      else if (ofs < FAR_OFS)
+        expected = zeros;
+      else
+        expected = data + GROWN_SIZE;
+      compare_bytes (buf, expected, CHUNK, ofs, file_name);
+    }
+  msg ("read \"%s\" back", file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-grow-sparse) begin
+(lg-grow-sparse) create "grown"
+(lg-grow-sparse) open "grown"
+(lg-grow-sparse) grow "grown" to 163840 bytes
+(lg-grow-sparse) write at offset 1048576
+(lg-grow-sparse) check file size
+(lg-grow-sparse) read "grown" back
+(lg-grow-sparse) close "grown"
+(lg-grow-sparse) end
+EOF
+pass;
@@ -0,0 +1,73 @@
+/* Creates enough files in one directory to make its table grow
+   several times, then checks that every name still leads to its
+   own file, removes them in two rounds and looks all of them up
+   after each. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+/* Opens file number I and checks that it is there, and that it is
+   the file created for it, if PRESENT, or that it is gone if not. */
+static void
+look_up (int i, bool present) 
+{
+  char name[16];
+  int fd;
+
+  snprintf (name, sizeof name, "file%d", i);
+  fd = open (name);
+  if (!present)
+    {
+      if (fd != -1)
+        fail ("\"%s\" was removed but opened", name);
+      return;
+    }
+  if (fd < 2)
+    fail ("open \"%s\"", name);
+  if (filesize (fd) != i)
+    fail ("\"%s\" has %d bytes instead of %d", name, filesize (fd), i);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, i))
+        fail ("create \"%s\"", name);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i++)
+    look_up (i, true);
+  msg ("looked up %d files", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  for (i = 0; i < FILE_CNT; i++)
+    look_up (i, i % 2 != 0);
+  msg ("removed every other file");
+
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  for (i = 0; i < FILE_CNT; i++)
+    look_up (i, false);
+  msg ("removed the rest");
+}
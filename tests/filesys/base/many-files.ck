@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(many-files) begin
+(many-files) created 200 files
+(many-files) looked up 200 files
+(many-files) removed every other file
+(many-files) removed the rest
+(many-files) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Grows a file, closes it and opens it again, first while its inode
+   is still kept in memory after the close and then after opening
+   enough other files to push it out, and checks each time that the
+   file kept its length and data. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* More than the kernel keeps in memory after their last close. */
+#define OTHER_CNT 48
+
+static char buf[5000];
+static char buf2[sizeof buf];
+
+/* Opens FILE_NAME and checks its length and contents against BUF. */
+static void
+check_reopened (const char *file_name) 
+{
+  int fd;
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  if (filesize (fd) != sizeof buf)
+    fail ("\"%s\" has %d bytes instead of %zu",
+          file_name, filesize (fd), sizeof buf);
+  if (read (fd, buf2, sizeof buf2) != sizeof buf2)
+    fail ("read \"%s\"", file_name);
+  compare_bytes (buf2, buf, sizeof buf, 0, file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "reopened";
+  char name[16];
+  int fd, i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_reopened (file_name);
+
+  for (i = 0; i < OTHER_CNT; i++)
+    {
+      snprintf (name, sizeof name, "other%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\"", name);
+      close (fd);
+    }
+  msg ("opened and closed %d other files", OTHER_CNT);
+
+  check_reopened (file_name);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(reopen-closed) begin
+(reopen-closed) create "reopened"
+(reopen-closed) open "reopened"
+(reopen-closed) write "reopened"
+(reopen-closed) close "reopened"
+(reopen-closed) open "reopened"
+(reopen-closed) close "reopened"
+(reopen-closed) opened and closed 48 other files
+(reopen-closed) open "reopened"
+(reopen-closed) close "reopened"
+(reopen-closed) end
+EOF
+pass;
@@ -0,0 +1,36 @@
+/* Looks a name up, removes the file and creates a different one
+   under the same name, several times over, and checks that each
+   lookup finds the file that has the name at the time: none right
+   after the removal, and the new one after the creation, even while
+   the old one is still open. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUNDS 4
+
+void
+test_main (void) 
+{
+  const char *file_name = "recreated";
+  int old_fd = -1, fd, i;
+
+  CHECK (create (file_name, 100), "create \"%s\"", file_name);
+  for (i = 1; i <= ROUNDS; i++)
+    {
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      if (filesize (fd) != 100 * i)
+        fail ("\"%s\" has %d bytes instead of %d",
+              file_name, filesize (fd), 100 * i);
+      if (old_fd != -1)
+        close (old_fd);
+      old_fd = fd;
+
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+      CHECK (open (file_name) == -1, "open \"%s\" after removal", file_name);
+      CHECK (create (file_name, 100 * (i + 1)), "create \"%s\" again",
+             file_name);
+    }
+  close (old_fd);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-recreate) begin
+(sm-recreate) create "recreated"
+(sm-recreate) open "recreated"
+(sm-recreate) remove "recreated"
+(sm-recreate) open "recreated" after removal
+(sm-recreate) create "recreated" again
+(sm-recreate) open "recreated"
+(sm-recreate) remove "recreated"
+(sm-recreate) open "recreated" after removal
+(sm-recreate) create "recreated" again
+(sm-recreate) open "recreated"
+(sm-recreate) remove "recreated"
+(sm-recreate) open "recreated" after removal
+(sm-recreate) create "recreated" again
+(sm-recreate) open "recreated"
+(sm-recreate) remove "recreated"
+(sm-recreate) open "recreated" after removal
+(sm-recreate) create "recreated" again
+(sm-recreate) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Changes a file through a mapping and unmaps it, which leaves the
+   changes in the page cache only, then touches more anonymous memory
+   than the machine has, so that the cached pages are evicted.  Reads
+   the file back, which must miss the cache, and checks that the
+   eviction wrote the changes to disk. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE (64 * 4096)
+#define ANON_SIZE (6 * 1024 * 1024)
+#define ACTUAL ((char *) 0x10000000)
+
+static const char file_name[] = "data";
+static char buf[TEST_SIZE];
+static char rbuf[TEST_SIZE];
+static char anon[ANON_SIZE];
+
+void
+test_main (void) {
+  long long read_cnt;
+  size_t i;
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (mmap (ACTUAL, sizeof buf, 1, fd, 0) != MAP_FAILED,
+         "mmap \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  memcpy (ACTUAL, buf, sizeof buf);
+  munmap (ACTUAL);
+  msg ("write \"%s\" through the mapping and unmap it", file_name);
+
+  for (i = 0; i < sizeof anon; i += 4096)
+    anon[i] = i / 4096;
+  msg ("touch %d kB of anonymous memory", ANON_SIZE / 1024);
+
+  read_cnt = get_fs_disk_read_cnt ();
+  CHECK (read (fd, rbuf, sizeof rbuf) == sizeof rbuf,
+         "read \"%s\"", file_name);
+  CHECK (get_fs_disk_read_cnt () > read_cnt, "check read_cnt");
+  compare_bytes (rbuf, buf, sizeof buf, 0, file_name);
+
+  for (i = 0; i < sizeof anon; i += 4096)
+    if (anon[i] != (char) (i / 4096))
+      fail ("anonymous page %zu changed", i / 4096);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
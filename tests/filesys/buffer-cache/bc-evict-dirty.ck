@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-evict-dirty) begin
+(bc-evict-dirty) create "data"
+(bc-evict-dirty) open "data"
+(bc-evict-dirty) mmap "data"
+(bc-evict-dirty) write "data" through the mapping and unmap it
+(bc-evict-dirty) touch 6144 kB of anonymous memory
+(bc-evict-dirty) read "data"
+(bc-evict-dirty) check read_cnt
+(bc-evict-dirty) close "data"
+(bc-evict-dirty) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Checks that fsync() puts data written to a file on disk, and that
+   a second fsync() with nothing new to write does not touch it. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 4096
+
+static const char file_name[] = "data";
+static char buf[TEST_SIZE];
+
+void
+test_main (void) {
+  long long write_cnt;
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+
+  write_cnt = get_fs_disk_write_cnt ();
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", file_name);
+  CHECK (fsync (fd) == 0, "fsync \"%s\"", file_name);
+  CHECK (get_fs_disk_write_cnt () >= write_cnt + TEST_SIZE / 512,
+         "check write_cnt after fsync");
+
+  write_cnt = get_fs_disk_write_cnt ();
+  CHECK (fsync (fd) == 0, "fsync \"%s\" again", file_name);
+  CHECK (get_fs_disk_write_cnt () == write_cnt,
+         "check write_cnt after second fsync");
+
+  CHECK (fsync (fd + 1) == -1, "fsync bad fd");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-fsync) begin
+(bc-fsync) create "data"
+(bc-fsync) open "data"
+(bc-fsync) write "data"
+(bc-fsync) fsync "data"
+(bc-fsync) check write_cnt after fsync
+(bc-fsync) fsync "data" again
+(bc-fsync) check write_cnt after second fsync
+(bc-fsync) fsync bad fd
+(bc-fsync) close "data"
+(bc-fsync) end
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Maps a file and changes it both through the mapping and with
+   write(), checking that each side sees the other's changes right
+   away, without unmapping the file. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE (2 * 4096)
+#define ACTUAL ((char *) 0x10000000)
+
+static const char file_name[] = "data";
+static char buf[TEST_SIZE];
+static char rbuf[TEST_SIZE];
+
+void
+test_main (void) {
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", file_name);
+  CHECK (mmap (ACTUAL, sizeof buf, 1, fd, 0) != MAP_FAILED,
+         "mmap \"%s\"", file_name);
+  compare_bytes (ACTUAL, buf, sizeof buf, 0, file_name);
+
+  /* write() shows through the mapping. */
+  random_bytes (buf, sizeof buf);
+  seek (fd, 0);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\" while mapped", file_name);
+  compare_bytes (ACTUAL, buf, sizeof buf, 0, file_name);
+
+  /* A store through the mapping shows in read(). */
+  random_bytes (buf, sizeof buf);
+  memcpy (ACTUAL, buf, sizeof buf);
+  msg ("store through the mapping");
+  seek (fd, 0);
+  CHECK (read (fd, rbuf, sizeof rbuf) == sizeof rbuf,
+         "read \"%s\" while mapped", file_name);
+  compare_bytes (rbuf, buf, sizeof buf, 0, file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
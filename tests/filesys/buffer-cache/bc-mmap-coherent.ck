@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-mmap-coherent) begin
+(bc-mmap-coherent) create "data"
+(bc-mmap-coherent) open "data"
+(bc-mmap-coherent) write "data"
+(bc-mmap-coherent) mmap "data"
+(bc-mmap-coherent) write "data" while mapped
+(bc-mmap-coherent) store through the mapping
+(bc-mmap-coherent) read "data" while mapped
+(bc-mmap-coherent) close "data"
+(bc-mmap-coherent) end
+EOF
+pass;
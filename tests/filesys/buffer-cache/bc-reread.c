@@ -0,0 +1,43 @@
+/* Writes a file that fits in the buffer cache, then reads it back
+   several times.  Every read after the first write should be served
+   from the cache without touching the disk. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE (32 * 512)
+#define PASSES 8
+
+static const char file_name[] = "data";
+static char buf[TEST_SIZE];
+static char rbuf[TEST_SIZE];
+
+void
+test_main (void) {
+  long long read_cnt, write_cnt;
+  int fd, i;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", file_name);
+
+  read_cnt = get_fs_disk_read_cnt ();
+  write_cnt = get_fs_disk_write_cnt ();
+  for (i = 0; i < PASSES; i++)
+    {
+      seek (fd, 0);
+      if (read (fd, rbuf, sizeof rbuf) != sizeof rbuf)
+        fail ("read \"%s\" failed in pass %d", file_name, i);
+      compare_bytes (rbuf, buf, sizeof buf, 0, file_name);
+    }
+  msg ("read \"%s\" %d times", file_name, PASSES);
+
+  CHECK (get_fs_disk_read_cnt () == read_cnt, "check read_cnt");
+  CHECK (get_fs_disk_write_cnt () == write_cnt, "check write_cnt");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-reread) begin
+(bc-reread) create "data"
+(bc-reread) open "data"
+(bc-reread) write "data"
+(bc-reread) read "data" 8 times
+(bc-reread) check read_cnt
+(bc-reread) check write_cnt
+(bc-reread) close "data"
+(bc-reread) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Fills a 2 MB-aligned block of a large zeroed buffer, which the
+   kernel may map with a single huge page, then drops one 4 kB page
+   from the middle of it with MADV_DONTNEED.  That splits the huge
+   mapping.  Every page of the block, including the one advised,
+   must keep its contents, and the neighbours must stay writable. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define BLOCK_SIZE (2 * 1024 * 1024)
+#define PAGE_CNT (BLOCK_SIZE / PAGE_SIZE)
+#define SPLIT_PAGE 100
+
+static char buf[2 * BLOCK_SIZE];
+
+void
+test_main (void)
+{
+  char *block = (char *) (((uintptr_t) buf + BLOCK_SIZE - 1)
+                          & ~(uintptr_t) (BLOCK_SIZE - 1));
+  size_t i;
+
+  msg ("fill block");
+  for (i = 0; i < PAGE_CNT; i++)
+    block[i * PAGE_SIZE] = (char) (i + 1);
+
+  CHECK (madvise (block + SPLIT_PAGE * PAGE_SIZE, PAGE_SIZE,
+                  MADV_DONTNEED) == 0, "madvise (MADV_DONTNEED) one page");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (block[i * PAGE_SIZE] != (char) (i + 1))
+      fail ("page %zu lost its contents", i);
+
+  msg ("rewrite neighbours");
+  block[(SPLIT_PAGE - 1) * PAGE_SIZE] = 'a';
+  block[(SPLIT_PAGE + 1) * PAGE_SIZE] = 'b';
+  if (block[(SPLIT_PAGE - 1) * PAGE_SIZE] != 'a'
+      || block[(SPLIT_PAGE + 1) * PAGE_SIZE] != 'b'
+      || block[SPLIT_PAGE * PAGE_SIZE] != (char) (SPLIT_PAGE + 1))
+    fail ("pages next to the split one read back wrong");
+}
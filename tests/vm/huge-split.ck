@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(huge-split) begin
+(huge-split) fill block
+(huge-split) madvise (MADV_DONTNEED) one page
+(huge-split) rewrite neighbours
+(huge-split) end
+EOF
+pass;
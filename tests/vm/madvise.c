@@ -0,0 +1,68 @@
+/* Gives each kind of advice about a file mapping and an anonymous
+   buffer, locks and unlocks the buffer, and checks that the data
+   survives all of it.  MADV_DONTNEED must shrink the resident set,
+   as memstat() reports it, unless the pages are locked. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 16
+
+static char buf[(PAGE_CNT + 1) * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char *pages = (char *) (((uintptr_t) buf + PAGE_SIZE - 1)
+                          & ~(uintptr_t) (PAGE_SIZE - 1));
+  long long rss;
+  int handle;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (actual, 4096, 0, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (actual, 4096, MADV_SEQUENTIAL) == 0,
+         "madvise (MADV_SEQUENTIAL)");
+  CHECK (madvise (actual, 4096, MADV_WILLNEED) == 0,
+         "madvise (MADV_WILLNEED)");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    pages[i * PAGE_SIZE] = i + 1;
+  rss = memstat (MEMSTAT_RSS);
+  CHECK (madvise (pages, PAGE_CNT * PAGE_SIZE, MADV_DONTNEED) == 0,
+         "madvise (MADV_DONTNEED)");
+  if (memstat (MEMSTAT_RSS) > rss - PAGE_CNT)
+    fail ("RSS went from %lld to only %lld pages", rss,
+          memstat (MEMSTAT_RSS));
+  for (i = 0; i < PAGE_CNT; i++)
+    if (pages[i * PAGE_SIZE] != (char) (i + 1))
+      fail ("page %zu lost its contents", i);
+
+  CHECK (mlock (pages, PAGE_CNT * PAGE_SIZE) == 0, "mlock");
+  rss = memstat (MEMSTAT_RSS);
+  CHECK (madvise (pages, PAGE_CNT * PAGE_SIZE, MADV_DONTNEED) == 0,
+         "madvise (MADV_DONTNEED) on locked pages");
+  if (memstat (MEMSTAT_RSS) < rss)
+    fail ("RSS dropped from %lld to %lld pages with the pages locked",
+          rss, memstat (MEMSTAT_RSS));
+  for (i = 0; i < PAGE_CNT; i++)
+    if (pages[i * PAGE_SIZE] != (char) (i + 1))
+      fail ("locked page %zu lost its contents", i);
+  CHECK (munlock (pages, PAGE_CNT * PAGE_SIZE) == 0, "munlock");
+
+  CHECK (madvise (pages, PAGE_SIZE, -1) == -1, "madvise (-1)");
+  CHECK (madvise (pages + 1, PAGE_SIZE, MADV_NORMAL) == -1,
+         "madvise at misaligned address");
+  CHECK (mlock (actual + 2 * PAGE_SIZE, PAGE_SIZE) == -1,
+         "mlock of unmapped memory");
+}
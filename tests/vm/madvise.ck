@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise (MADV_SEQUENTIAL)
+(madvise) madvise (MADV_WILLNEED)
+(madvise) madvise (MADV_DONTNEED)
+(madvise) mlock
+(madvise) madvise (MADV_DONTNEED) on locked pages
+(madvise) munlock
+(madvise) madvise (-1)
+(madvise) madvise at misaligned address
+(madvise) mlock of unmapped memory
+(madvise) end
+EOF
+pass;
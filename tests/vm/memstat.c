@@ -0,0 +1,37 @@
+/* Touches pages of a buffer and checks that the resident set and
+   fault counts reported by memstat() grow accordingly. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  long long rss, faults;
+  size_t i;
+
+  rss = memstat (MEMSTAT_RSS);
+  faults = memstat (MEMSTAT_FAULTS);
+  CHECK (rss > 0, "memstat (MEMSTAT_RSS)");
+  CHECK (memstat (-1) == -1, "memstat (-1)");
+
+  /* Give each page different contents, so none of them gets merged. */
+  msg ("touch %d pages", PAGE_CNT);
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i + 1;
+
+  if (memstat (MEMSTAT_RSS) < rss + PAGE_CNT)
+    fail ("RSS grew from %lld to only %lld pages",
+          rss, memstat (MEMSTAT_RSS));
+  if (memstat (MEMSTAT_FAULTS) <= faults)
+    fail ("no page faults counted");
+  if (memstat (MEMSTAT_WSS) > memstat (MEMSTAT_RSS))
+    fail ("working set larger than resident set");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memstat) begin
+(memstat) memstat (MEMSTAT_RSS)
+(memstat) memstat (-1)
+(memstat) touch 64 pages
+(memstat) end
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Reads from a file into a read-only mapping, which must kill the
+   process, and then checks that another process can still read the
+   file, that is, that the kernel did not give up with the file system
+   lock held. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+/* Opens "sample.txt", or exits with status 1. */
+static int
+open_sample (void)
+{
+  int handle = open ("sample.txt");
+
+  if (handle < 2)
+    exit (1);
+  return handle;
+}
+
+void
+test_main (void)
+{
+  char buf[16];
+  pid_t child;
+
+  child = fork ("reader-ro");
+  if (child == 0)
+    {
+      int handle = open_sample ();
+      volatile char c;
+
+      if (mmap (ACTUAL, 4096, 0, handle, 0) == MAP_FAILED)
+        exit (1);
+
+      /* Make the page resident first. */
+      c = ACTUAL[0];
+      (void) c;
+      read (handle, ACTUAL, sizeof buf);
+      exit (2);
+    }
+  CHECK (child > 0, "fork");
+  CHECK (wait (child) == -1, "read into read-only mapping killed the child");
+
+  child = fork ("reader");
+  if (child == 0)
+    exit (read (open_sample (), buf, sizeof buf) == sizeof buf ? 0 : 1);
+  CHECK (child > 0, "fork");
+  CHECK (wait (child) == 0, "another child can still read");
+}
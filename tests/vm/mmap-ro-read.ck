@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-ro-read) begin
+(mmap-ro-read) fork
+(mmap-ro-read) read into read-only mapping killed the child
+(mmap-ro-read) fork
+(mmap-ro-read) another child can still read
+(mmap-ro-read) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Touches consecutive pages of a buffer and checks that their frames
+   have distinct cache colours, so that a strided walk over them does
+   not keep evicting its own cache lines. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define COLOR_CNT 16
+
+static char buf[(COLOR_CNT + 1) * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  char *pages = (char *) (((uintptr_t) buf + PAGE_SIZE - 1)
+                          & ~(uintptr_t) (PAGE_SIZE - 1));
+  unsigned seen = 0;
+  size_t i;
+
+  /* Give each page different contents, so none of them gets merged. */
+  msg ("touch %d pages", COLOR_CNT);
+  for (i = 0; i < COLOR_CNT; i++)
+    pages[i * PAGE_SIZE] = i + 1;
+
+  for (i = 0; i < COLOR_CNT; i++)
+    {
+      uintptr_t pa = (uintptr_t) get_phys_addr (pages + i * PAGE_SIZE);
+      unsigned color = (pa / PAGE_SIZE) % COLOR_CNT;
+
+      if (seen & (1u << color))
+        fail ("page %zu has the colour of an earlier page", i);
+      seen |= 1u << color;
+    }
+}
@@ -0,0 +1,56 @@
+/* Forks a child and has parent and child sweep the same virtual
+   pages, each holding its own data, long enough to be switched back
+   and forth many times by the timer.  A TLB entry of one process
+   surviving a switch to the other would make it see the other's data.
+   The number of address space switches and of TLB flushes they caused
+   is reported in the kernel's statistics at power-off. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 32
+#define ROUNDS 1000
+#define WORDS (PAGE_CNT * PAGE_SIZE / sizeof (uint32_t))
+
+static uint32_t buf[WORDS];
+
+/* Fills BUF with values derived from TAG, then checks them, ROUNDS
+   times.  Returns the number of mismatches. */
+static int
+sweep (uint32_t tag)
+{
+  int errors = 0;
+  size_t r, i;
+
+  for (r = 0; r < ROUNDS; r++)
+    {
+      uint32_t value = tag ^ (r << 16);
+
+      for (i = 0; i < WORDS; i += PAGE_SIZE / sizeof (uint32_t))
+        buf[i] = value + i;
+      for (i = 0; i < WORDS; i += PAGE_SIZE / sizeof (uint32_t))
+        if (buf[i] != value + i)
+          errors++;
+    }
+  return errors;
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  msg ("ping-pong");
+  child = fork ("pong");
+  if (child == 0)
+    exit (sweep (0xc0de) != 0);
+
+  CHECK (child > 0, "fork");
+  if (sweep (0xbeef) != 0)
+    fail ("parent saw the child's pages");
+  if (wait (child) != 0)
+    fail ("child saw the parent's pages");
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pcid-pingpong) begin
+(pcid-pingpong) ping-pong
+(pcid-pingpong) fork
+(pcid-pingpong) end
+EOF
+
+our ($test);
+my ($stats) = grep (/^TLB: PCIDs (on|off), \d+ address space switches, \d+ full flushes$/,
+		    read_text_file ("$test.output"));
+fail "missing TLB statistics line\n" if !defined $stats;
+my ($pcids, $switches, $flushes)
+  = $stats =~ /PCIDs (on|off), (\d+) address space switches, (\d+) full flushes/;
+fail "only $switches address space switches; parent and child never ran in turn\n"
+  if $switches < 2;
+fail "PCIDs on, yet $flushes full flushes for $switches address space switches\n"
+  if $pcids eq 'on' && $flushes >= $switches;
+pass;
@@ -0,0 +1,52 @@
+/* Writes a file from a buffer and reads it back into another, both
+   spanning several pinning chunks and paged out just before the I/O,
+   so that the kernel has to bring them in and pin them. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 40
+#define SIZE (PAGE_CNT * PAGE_SIZE)
+
+static char src[SIZE + PAGE_SIZE];
+static char dst[SIZE + PAGE_SIZE];
+
+/* Returns the first page boundary in BUF. */
+static char *
+align (char *buf)
+{
+  return (char *) (((uintptr_t) buf + PAGE_SIZE - 1)
+                   & ~(uintptr_t) (PAGE_SIZE - 1));
+}
+
+void
+test_main (void)
+{
+  char *s = align (src);
+  char *d = align (dst);
+  int handle;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    s[i] = i * 7 + i / PAGE_SIZE;
+  d[0] = 1;
+
+  CHECK (create ("data", SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+
+  madvise (s, SIZE, MADV_DONTNEED);
+  CHECK (write (handle, s, SIZE) == SIZE, "write %d bytes", SIZE);
+
+  seek (handle, 0);
+  madvise (d, SIZE, MADV_DONTNEED);
+  CHECK (read (handle, d, SIZE) == SIZE, "read %d bytes", SIZE);
+  close (handle);
+
+  if (memcmp (s, d, SIZE))
+    fail ("data read back differs from data written");
+}
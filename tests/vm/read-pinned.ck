@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(read-pinned) begin
+(read-pinned) create "data"
+(read-pinned) open "data"
+(read-pinned) write 163840 bytes
+(read-pinned) read 163840 bytes
+(read-pinned) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Fills a buffer larger than memory with three kinds of pages in
+   turn: pages of one repeated byte, pages of long runs of letters,
+   which compress well, and pages of pseudo-random bytes, which do
+   not.  Eviction sends the first two kinds to zswap and the last to
+   the swap disk.  Every byte of every page must read back as
+   written once the pages fault back in.
+   For this test, Pintos memory size is 10MB. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define CHUNK_SIZE (16 * 1024 * 1024)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+static char big_chunks[CHUNK_SIZE];
+static char expected[PAGE_SIZE];
+
+/* Fills P with the contents page I should have. */
+static void
+fill_page (char *p, size_t i)
+{
+  uint32_t seed = i * 2654435761u + 1;
+  size_t j;
+
+  switch (i % 3)
+    {
+    case 0:
+      memset (p, (char) i, PAGE_SIZE);
+      break;
+    case 1:
+      for (j = 0; j < PAGE_SIZE; j++)
+        p[j] = 'a' + (j / 64 + i) % 26;
+      break;
+    case 2:
+      for (j = 0; j < PAGE_SIZE; j++)
+        {
+          seed = seed * 1103515245 + 12345;
+          p[j] = seed >> 16;
+        }
+      break;
+    }
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("fill %d pages", PAGE_COUNT);
+  for (i = 0; i < PAGE_COUNT; i++)
+    fill_page (big_chunks + i * PAGE_SIZE, i);
+
+  msg ("check %d pages", PAGE_COUNT);
+  for (i = 0; i < PAGE_COUNT; i++)
+    {
+      fill_page (expected, i);
+      if (memcmp (big_chunks + i * PAGE_SIZE, expected, PAGE_SIZE))
+        fail ("page %zu (kind %zu) read back wrong", i, i % 3);
+    }
+}
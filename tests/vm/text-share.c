@@ -0,0 +1,25 @@
+/* Forks children and checks that each maps the page of code it runs
+   to the same frame as the parent, instead of a copy of its own. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void)
+{
+  void *code = get_phys_addr ((void *) test_main);
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pid_t child = fork ("child");
+      if (child == 0)
+        exit (get_phys_addr ((void *) test_main) == code ? 0 : 1);
+      CHECK (child > 0, "fork child %d", i);
+      if (wait (child) != 0)
+        fail ("child %d has its own copy of the code", i);
+    }
+}
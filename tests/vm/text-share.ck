@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(text-share) begin
+(text-share) fork child 0
+(text-share) fork child 1
+(text-share) fork child 2
+(text-share) fork child 3
+(text-share) end
+EOF
+pass;
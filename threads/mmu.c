@@ -1,15 +1,117 @@
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers.
+
+   With CR4.PCIDE set, the low 12 bits of CR3 name the address space
+   the TLB entries belong to, and loading CR3 with bit 63 set keeps the
+   TLB entries of every address space instead of flushing them.  Each
+   pml4 is then given a PCID of its own, so that switching back to a
+   process finds its translations still cached.
+
+   PCID 0 belongs to base_pml4.  The others are handed out round-robin
+   and PCID_OWNER records which pml4 holds each one; a pml4 whose PCID
+   was taken over by another one gets a new PCID, with a full flush, the
+   next time it is activated.  The PCID and a "stale" flag are kept in
+   the pml4 itself, in PML4_META, an entry that user and kernel
+   mappings never use and whose present bit is always clear.
+
+   A mapping of the current pml4 is invalidated on the spot with
+   invlpg.  Changing one of another pml4 marks it stale instead, so
+   that its TLB entries get flushed when it is next activated.
+
+   Without PCID support, pml4_activate() simply loads CR3, flushing
+   the whole TLB, unless the pml4 is active already. */
+
+#define CR4_PCIDE (1 << 17)         /* CR4 bit enabling PCIDs. */
+#define CPUID_PCID (1 << 17)        /* CPUID.01H:ECX bit for PCIDs. */
+#define CR3_NOFLUSH (1ULL << 63)    /* Keep TLB entries when loading CR3. */
+
+#define PCID_CNT 256                /* PCIDs in use, out of 4096. */
+#define PML4_META 511               /* pml4 entry holding PCID and flags. */
+#define META_STALE 0x2              /* TLB may hold outdated entries. */
+#define META_PCID(m) (((m) >> 12) & 0xfff)
+
+static bool pcid_enabled;
+static uint64_t *pcid_owner[PCID_CNT];
+static unsigned pcid_next = 1;
+
+/* Statistics. */
+static uint64_t switch_cnt;         /* Loads of a different CR3. */
+static uint64_t flush_cnt;          /* ...that flushed the TLB. */
+
+/* Turns on PCIDs if the CPU supports them.  Must be called with
+ * base_pml4 active. */
+void
+pcid_init (void) {
+	uint32_t ecx;
+
+	cpuid (1, NULL, NULL, &ecx, NULL);
+	if (!(ecx & CPUID_PCID))
+		return;
+
+	ASSERT ((rcr3 () & PTE_FLAGS) == 0);
+	pcid_owner[0] = base_pml4;
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Prints TLB statistics. */
+void
+tlb_print_stats (void) {
+	printf ("TLB: PCIDs %s, %"PRIu64" address space switches, "
+			"%"PRIu64" full flushes\n",
+			pcid_enabled ? "on" : "off", switch_cnt, flush_cnt);
+}
+
+/* Drops the TLB entry for VA in PML4: right away if PML4 is active,
+ * otherwise when it is next activated.  Interrupts must be off since
+ * the entry was changed, lest PML4 run on its cached copy in between. */
+static void
+tlb_invalidate (uint64_t *pml4, uint64_t va) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (PTE_ADDR (rcr3 ()) == vtop (pml4))
+		invlpg (va);
+	else
+		pml4[PML4_META] |= META_STALE;
+}
+
+/* Replaces the 2 MB mapping of VA in page directory entry PDE of PML4
+ * by a page table of 512 equivalent 4 kB mappings, with the same
+ * permissions and accessed and dirty bits.  This happens whenever a
+ * single page of a huge mapping needs an entry of its own.  A huge
+ * mapping must stay splittable to be unmapped at all, so running out
+ * of memory for the page table is fatal. */
+static void
+pde_split (uint64_t *pml4, uint64_t *pde, const uint64_t va) {
+	uint64_t *pt = palloc_get_page (PAL_ASSERT);
+	uint64_t pa = PTE_ADDR (*pde);
+	uint64_t flags = *pde & PTE_FLAGS & ~(uint64_t) PTE_PS;
+	enum intr_level old_level;
+
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	old_level = intr_disable ();
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	/* PML4 may not be the current page map: the 2 MB entry then has
+	 * to go when it is next activated. */
+	tlb_invalidate (pml4, va);
+	intr_set_level (old_level);
+}
+
 static uint64_t *
-pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
+pgdir_walk (uint64_t *pml4, uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
@@ -22,14 +124,15 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 					return NULL;
 			} else
 				return NULL;
-		}
+		} else if ((uint64_t) pte & PTE_PS)
+			pde_split (pml4, &pdp[idx], va);
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
 }
 
 static uint64_t *
-pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
+pdpe_walk (uint64_t *pml4, uint64_t *pdpe, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
 	int idx = PDPE (va);
 	int allocated = 0;
@@ -46,7 +149,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
-		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
+		pte = pgdir_walk (pml4, ptov (PTE_ADDR (pdpe[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
@@ -79,7 +182,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
-		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
+		pte = pdpe_walk (pml4e, ptov (PTE_ADDR (pml4e[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
@@ -88,6 +191,22 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the page directory entry for VA in PML4 if it maps a
+ * present 2 MB page, otherwise a null pointer.  Never allocates or
+ * splits anything. */
+static uint64_t *
+huge_pde (uint64_t *pml4, const uint64_t va) {
+	uint64_t e = pml4[PML4 (va)];
+	if (!(e & PTE_P))
+		return NULL;
+	e = ((uint64_t *) ptov (PTE_ADDR (e)))[PDPE (va)];
+	if (!(e & PTE_P))
+		return NULL;
+
+	uint64_t *pde = &((uint64_t *) ptov (PTE_ADDR (e)))[PDX (va)];
+	return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -95,8 +214,11 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 uint64_t *
 pml4_create (void) {
 	uint64_t *pml4 = palloc_get_page (0);
-	if (pml4)
+	if (pml4) {
 		memcpy (pml4, base_pml4, PGSIZE);
+		/* No PCID yet; one is assigned on first activation. */
+		pml4[PML4_META] = 0;
+	}
 	return pml4;
 }
 
@@ -118,25 +240,33 @@ pt_for_each (uint64_t *pt, pte_for_each_func *func, void *aux,
 }
 
 static bool
-pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
-		unsigned pml4_index, unsigned pdp_index) {
+pgdir_for_each (uint64_t *pml4, uint64_t *pdp, pte_for_each_func *func,
+		void *aux, unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (((uint64_t) pte) & PTE_P) {
+			/* FUNC works on 4 kB entries. */
+			if (((uint64_t) pte) & PTE_PS) {
+				pde_split (pml4, &pdp[i], ((uint64_t) pml4_index << PML4SHIFT)
+						| ((uint64_t) pdp_index << PDPESHIFT)
+						| ((uint64_t) i << PDXSHIFT));
+				pte = ptov ((uint64_t *) pdp[i]);
+			}
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
+		}
 	}
 	return true;
 }
 
 static bool
-pdp_for_each (uint64_t *pdp,
+pdp_for_each (uint64_t *pml4, uint64_t *pdp,
 		pte_for_each_func *func, void *aux, unsigned pml4_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdp[i]);
 		if (((uint64_t) pde) & PTE_P)
-			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), func,
+			if (!pgdir_for_each (pml4, (uint64_t *) PTE_ADDR (pde), func,
 					 aux, pml4_index, i))
 				return false;
 	}
@@ -149,7 +279,7 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pdpe = ptov((uint64_t *) pml4[i]);
 		if (((uint64_t) pdpe) & PTE_P)
-			if (!pdp_for_each ((uint64_t *) PTE_ADDR (pdpe), func, aux, i))
+			if (!pdp_for_each (pml4, (uint64_t *) PTE_ADDR (pdpe), func, aux, i))
 				return false;
 	}
 	return true;
@@ -169,7 +299,9 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+			palloc_free_multiple ((void *) PTE_ADDR (pte), HPGSIZE / PGSIZE);
+		else if (((uint64_t) pte) & PTE_P)
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -196,14 +328,62 @@ pml4_destroy (uint64_t *pml4) {
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+	if (pcid_owner[META_PCID (pml4[PML4_META])] == pml4)
+		pcid_owner[META_PCID (pml4[PML4_META])] = NULL;
 	palloc_free_page ((void *) pml4);
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  With PCIDs, the TLB entries cached for PD the last time
+ * it was active are kept, unless PD has been changed since. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	uint64_t cr3, meta;
+	unsigned pcid;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	cr3 = vtop (pml4);
+
+	old_level = intr_disable ();
+	meta = pml4 != base_pml4 ? pml4[PML4_META] : 0;
+
+	/* Nothing to do if PML4 is active already, since changes to the
+	 * active pml4 are invalidated as they are made. */
+	if (PTE_ADDR (rcr3 ()) == cr3 && !(meta & META_STALE)) {
+		intr_set_level (old_level);
+		return;
+	}
+	switch_cnt++;
+
+	if (!pcid_enabled) {
+		if (pml4 != base_pml4)
+			pml4[PML4_META] = 0;
+		flush_cnt++;
+		lcr3 (cr3);
+		intr_set_level (old_level);
+		return;
+	}
+
+	pcid = META_PCID (meta);
+	if (pcid_owner[pcid] != pml4) {
+		/* Take over the next PCID; whatever its previous owner left
+		 * in the TLB must go. */
+		pcid = pcid_next;
+		pcid_next = pcid_next + 1 < PCID_CNT ? pcid_next + 1 : 1;
+		pcid_owner[pcid] = pml4;
+		meta |= META_STALE;
+	}
+	if (pml4 != base_pml4)
+		pml4[PML4_META] = (uint64_t) pcid << 12;
+
+	if (meta & META_STALE) {
+		flush_cnt++;
+		lcr3 (cr3 | pcid);
+	} else
+		lcr3 (cr3 | pcid | CR3_NOFLUSH);
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -214,6 +394,10 @@ void *
 pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
+	uint64_t *pde = huge_pde (pml4, (uint64_t) uaddr);
+	if (pde != NULL)
+		return ptov (PTE_ADDR (*pde)) + ((uint64_t) uaddr & HPGMASK);
+
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
 	if (pte && (*pte & PTE_P))
@@ -238,11 +422,65 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		enum intr_level old_level = intr_disable ();
+		bool was_present = (*pte & PTE_P) != 0;
+
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		/* Remapping or changing permissions. */
+		if (was_present)
+			tlb_invalidate (pml4, (uint64_t) upage);
+		intr_set_level (old_level);
+	}
 	return pte != NULL;
 }
 
+/* Maps the 2 MB of user virtual memory at UPAGE in PML4 to the
+ * physically contiguous frames at KPAGE, with a single page directory
+ * entry.  Both addresses must be 2 MB aligned, and no page of the range
+ * may be mapped yet.  If WRITABLE is true the pages are read/write,
+ * otherwise read-only.  Returns true if successful, false if memory
+ * allocation failed or part of the range is already mapped.
+ *
+ * Any later change to a single page of the range, through the other
+ * pml4_*() functions, splits the mapping into 4 kB ones first. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t va = (uint64_t) upage;
+	uint64_t *pt, *pde;
+	enum intr_level old_level;
+
+	ASSERT (((uint64_t) upage & HPGMASK) == 0);
+	ASSERT (((uint64_t) kpage & HPGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	/* Build the upper levels, then trade the page table for the
+	 * huge entry. */
+	if (pml4e_walk (pml4, va, 1) == NULL)
+		return false;
+	pt = ptov (PTE_ADDR (pml4[PML4 (va)]));
+	pt = ptov (PTE_ADDR (pt[PDPE (va)]));
+	pde = &pt[PDX (va)];
+	pt = ptov (PTE_ADDR (*pde));
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+		if (pt[i] & PTE_P)
+			return false;
+
+	palloc_free_page (pt);
+	old_level = intr_disable ();
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	tlb_invalidate (pml4, va);
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Returns true if VPAGE is part of a 2 MB mapping in PML4. */
+bool
+pml4_is_huge (uint64_t *pml4, const void *vpage) {
+	return huge_pde (pml4, (uint64_t) vpage) != NULL;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -256,9 +494,10 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
+		enum intr_level old_level = intr_disable ();
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, (uint64_t) upage);
+		intr_set_level (old_level);
 	}
 }
 
@@ -268,6 +507,10 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
+	uint64_t *pde = huge_pde (pml4, (uint64_t) vpage);
+	if (pde != NULL)
+		return (*pde & PTE_D) != 0;
+
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
@@ -278,13 +521,14 @@ void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	if (pte) {
+		enum intr_level old_level = intr_disable ();
 		if (dirty)
 			*pte |= PTE_D;
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
+		intr_set_level (old_level);
 	}
 }
 
@@ -294,6 +538,10 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
+	uint64_t *pde = huge_pde (pml4, (uint64_t) vpage);
+	if (pde != NULL)
+		return (*pde & PTE_A) != 0;
+
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
@@ -309,7 +557,9 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
+		/* A cached entry only hides later accesses from the clock
+		 * hand, so another pml4 is not flushed for this. */
+		if (PTE_ADDR (rcr3 ()) == vtop (pml4))
 			invlpg ((uint64_t) vpage);
 	}
 }
@@ -2,12 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,15 +26,38 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each free page is also on one of PALLOC_COLOR_CNT free lists,
+   according to its "colour", the group of cache sets its lines map
+   to in a physically indexed cache.  First-fit allocation from the
+   bitmap packs user frames at the bottom of the pool with no regard
+   to colour, so a process's pages tend to compete for the same sets.
+   palloc_get_page_colored() instead takes a page of the colour asked
+   for, and the VM asks for consecutive colours for consecutive
+   virtual pages.  The list element lives in the free page itself, so
+   the lists are only set up by palloc_init_colors(), once all of
+   memory is mapped; until then the bitmap alone is kept. */
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t free_cnt;                /* Number of free pages. */
+	struct list free_lists[PALLOC_COLOR_CNT];  /* Free pages, by colour. */
 };
 
+/* Returns the colour of PAGE. */
+#define page_color(PAGE) (pg_no (PAGE) % PALLOC_COLOR_CNT)
+
+/* Whether the free lists are set up. */
+static bool colors_ready;
+
+/* Statistics for palloc_get_page_colored(). */
+static uint64_t color_hit_cnt;      /* Pages of the colour asked for. */
+static uint64_t color_miss_cnt;     /* Pages of another colour. */
+
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
@@ -41,8 +66,43 @@ size_t user_page_limit = SIZE_MAX;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
+static void init_free_lists (struct pool *);
 static bool page_from_pool (const struct pool *, void *page);
 
+/* Adds the PAGE_CNT free pages at PAGES to POOL's free lists and
+   free count.  Must be called with interrupts off, because pages are
+   freed from the scheduler. */
+static void
+pool_give (struct pool *pool, uint8_t *pages, size_t page_cnt) {
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	pool->free_cnt += page_cnt;
+	if (!colors_ready)
+		return;
+	for (i = 0; i < page_cnt; i++) {
+		uint8_t *page = pages + i * PGSIZE;
+		list_push_front (&pool->free_lists[page_color (page)],
+				(struct list_elem *) page);
+	}
+}
+
+/* Takes the PAGE_CNT pages at PAGES, just marked used in POOL's
+   bitmap, off its free lists and free count.  These are also updated
+   by palloc_free_multiple(), which cannot take the pool lock. */
+static void
+pool_take (struct pool *pool, uint8_t *pages, size_t page_cnt) {
+	enum intr_level old_level = intr_disable ();
+	size_t i;
+
+	if (colors_ready)
+		for (i = 0; i < page_cnt; i++)
+			list_remove ((struct list_elem *) (pages + i * PGSIZE));
+	pool->free_cnt -= page_cnt;
+	intr_set_level (old_level);
+}
+
 /* multiboot info */
 struct multiboot_info {
 	uint32_t flags;
@@ -250,9 +310,25 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	kernel_pool.free_cnt = bitmap_count (kernel_pool.used_map, 0,
+			bitmap_size (kernel_pool.used_map), false);
+	user_pool.free_cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
 	return ext_mem.end;
 }
 
+/* Sets up the free lists of both pools.  Must be called once, after
+   paging_init() has mapped all of memory. */
+void
+palloc_init_colors (void) {
+	enum intr_level old_level = intr_disable ();
+
+	init_free_lists (&kernel_pool);
+	init_free_lists (&user_pool);
+	colors_ready = true;
+	intr_set_level (old_level);
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -265,13 +341,51 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 
 	lock_acquire (&pool->lock);
 	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
+	if (page_idx != BITMAP_ERROR) {
 		pages = pool->base + PGSIZE * page_idx;
-	else
+		pool_take (pool, pages, page_cnt);
+	} else
 		pages = NULL;
+	lock_release (&pool->lock);
+
+	if (pages) {
+		if (flags & PAL_ZERO)
+			memset (pages, 0, PGSIZE * page_cnt);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+	}
+
+	return pages;
+}
+
+/* Like palloc_get_multiple(), but the first page's address is a
+   multiple of ALIGN_CNT pages, which must be a power of 2.  Used for
+   huge pages, whose physical address must be aligned to their size. */
+void *
+palloc_get_multiple_aligned (enum palloc_flags flags, size_t page_cnt,
+		size_t align_cnt) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	size_t page_idx;
+	void *pages = NULL;
+
+	ASSERT (align_cnt != 0 && (align_cnt & (align_cnt - 1)) == 0);
+
+	/* Index of the first suitably aligned page of the pool. */
+	page_idx = ROUND_UP (pg_no (pool->base), align_cnt) - pg_no (pool->base);
+
+	lock_acquire (&pool->lock);
+	for (; page_idx + page_cnt <= pool_cnt; page_idx += align_cnt)
+		if (bitmap_none (pool->used_map, page_idx, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+			pages = pool->base + PGSIZE * page_idx;
+			pool_take (pool, pages, page_cnt);
+			break;
+		}
+	lock_release (&pool->lock);
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -296,6 +410,48 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
+/* Obtains a single free page of colour COLOR % PALLOC_COLOR_CNT, or
+   of the next colour that has a free page, and returns its kernel
+   virtual address.  FLAGS are as for palloc_get_page(). */
+void *
+palloc_get_page_colored (enum palloc_flags flags, size_t color) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	uint8_t *page = NULL;
+	size_t i;
+
+	if (!colors_ready)
+		return palloc_get_page (flags);
+
+	lock_acquire (&pool->lock);
+	enum intr_level old_level = intr_disable ();
+	for (i = 0; i < PALLOC_COLOR_CNT; i++) {
+		struct list *free_list =
+			&pool->free_lists[(color + i) % PALLOC_COLOR_CNT];
+
+		if (!list_empty (free_list)) {
+			page = (uint8_t *) list_pop_front (free_list);
+			bitmap_mark (pool->used_map, pg_no (page) - pg_no (pool->base));
+			pool->free_cnt--;
+			if (i == 0)
+				color_hit_cnt++;
+			else
+				color_miss_cnt++;
+			break;
+		}
+	}
+	intr_set_level (old_level);
+	lock_release (&pool->lock);
+
+	if (page) {
+		if (flags & PAL_ZERO)
+			memset (page, 0, PGSIZE);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+	}
+	return page;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
@@ -319,7 +475,11 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+	/* Pages are freed from the scheduler too, so no lock here. */
+	enum intr_level old_level = intr_disable ();
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	pool_give (pool, pages, page_cnt);
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +488,37 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool if PAL_USER is set
+   in FLAGS, otherwise in the kernel pool. */
+size_t
+palloc_free_cnt (enum palloc_flags flags) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	return pool->free_cnt;
+}
+
+/* Prints page colouring statistics. */
+void
+palloc_print_stats (void) {
+	printf ("Palloc: %"PRIu64" coloured pages, %"PRIu64" of another colour\n",
+			color_hit_cnt, color_miss_cnt);
+}
+
+/* Puts the free pages of pool P on its free lists. */
+static void
+init_free_lists (struct pool *p) {
+	size_t page_cnt = bitmap_size (p->used_map);
+	size_t i;
+
+	for (i = 0; i < PALLOC_COLOR_CNT; i++)
+		list_init (&p->free_lists[i]);
+	for (i = 0; i < page_cnt; i++)
+		if (!bitmap_test (p->used_map, i)) {
+			uint8_t *page = p->base + i * PGSIZE;
+			list_push_back (&p->free_lists[page_color (page)],
+					(struct list_elem *) page);
+		}
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -0,0 +1,210 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A typed object cache.
+
+   malloc() rounds every request up to a power of 2, so a 560-byte
+   struct inode occupies a 1 kB block and a handful of pointers in
+   struct frame take 32 bytes.  A slab cache instead packs objects of
+   one exact size into a page, called a "slab", whose header keeps a
+   stack of the indexes of its free objects.  Because the free list
+   lives in the header rather than inside the objects, a freed object
+   keeps its contents, which lets a constructor run only once per
+   object instead of once per allocation.
+
+   Each cache keeps the slabs that still have free objects on its
+   PARTIAL list.  Full slabs are on no list; the owning slab of any
+   object is found by rounding its address down to a page boundary.
+   When a slab becomes entirely free it is returned to the page
+   allocator, unless it is the cache's only partial slab, which is
+   kept to avoid thrashing at the boundary. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of each slab page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct slab_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in cache's PARTIAL list. */
+	uint16_t free_cnt;          /* Number of free objects. */
+	uint16_t free[];            /* Indexes of free objects. */
+};
+
+/* All caches, for slab_print_stats(). */
+static struct list caches;
+
+static struct slab *obj_to_slab (struct slab_cache *, void *);
+static void *slab_to_obj (struct slab_cache *, struct slab *, size_t idx);
+
+/* Initializes the slab allocator. */
+void
+slab_init (void) {
+	list_init (&caches);
+}
+
+/* Initializes CACHE to hand out objects of SIZE bytes, named NAME.
+   If CTOR is non-null, it is run on every object when the slab that
+   holds it is created. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name, size_t size,
+		slab_ctor_func *ctor) {
+	size_t n;
+
+	ASSERT (cache != NULL);
+	ASSERT (size > 0);
+
+	size = ROUND_UP (size, sizeof (void *));
+	for (n = (PGSIZE - sizeof (struct slab)) / size; n > 0; n--)
+		if (ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+					sizeof (void *)) + n * size <= PGSIZE)
+			break;
+	ASSERT (n > 0);
+
+	cache->name = name;
+	cache->obj_size = size;
+	cache->objs_per_slab = n;
+	cache->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+			sizeof (void *));
+	cache->ctor = ctor;
+	lock_init (&cache->lock);
+	list_init (&cache->partial);
+	cache->slab_cnt = 0;
+	cache->in_use = 0;
+	cache->alloc_cnt = 0;
+	list_push_back (&caches, &cache->elem);
+}
+
+/* Allocates a new slab page for CACHE with all of its objects free.
+   Returns a null pointer if no page is available. */
+static struct slab *
+slab_create (struct slab_cache *cache) {
+	struct slab *s = palloc_get_page (0);
+	size_t i;
+
+	if (s == NULL)
+		return NULL;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = cache;
+	s->free_cnt = cache->objs_per_slab;
+	for (i = 0; i < cache->objs_per_slab; i++) {
+		/* Hand out low indexes first. */
+		s->free[i] = cache->objs_per_slab - 1 - i;
+		if (cache->ctor != NULL)
+			cache->ctor (slab_to_obj (cache, s, i));
+	}
+	cache->slab_cnt++;
+	return s;
+}
+
+/* Obtains and returns an object from CACHE.
+   Returns a null pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *cache) {
+	struct slab *s;
+	void *obj;
+
+	lock_acquire (&cache->lock);
+	if (list_empty (&cache->partial)) {
+		s = slab_create (cache);
+		if (s == NULL) {
+			lock_release (&cache->lock);
+			return NULL;
+		}
+		list_push_front (&cache->partial, &s->elem);
+	} else
+		s = list_entry (list_front (&cache->partial), struct slab, elem);
+
+	obj = slab_to_obj (cache, s, s->free[--s->free_cnt]);
+	if (s->free_cnt == 0)
+		list_remove (&s->elem);
+	cache->in_use++;
+	cache->alloc_cnt++;
+	lock_release (&cache->lock);
+	return obj;
+}
+
+/* Returns OBJ, which must have been obtained from CACHE with
+   slab_alloc(), to CACHE.  A null OBJ is ignored. */
+void
+slab_free (struct slab_cache *cache, void *obj) {
+	struct slab *s;
+
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab (cache, obj);
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs, unless it
+	   must stay in its constructed state. */
+	if (cache->ctor == NULL)
+		memset (obj, 0xcc, cache->obj_size);
+#endif
+
+	lock_acquire (&cache->lock);
+	ASSERT (s->free_cnt < cache->objs_per_slab);
+	s->free[s->free_cnt++] =
+		((uint8_t *) obj - ((uint8_t *) s + cache->obj_ofs)) / cache->obj_size;
+	if (s->free_cnt == 1)
+		list_push_front (&cache->partial, &s->elem);
+	cache->in_use--;
+
+	/* Give an empty slab back, as long as another one stays behind. */
+	if (s->free_cnt == cache->objs_per_slab
+			&& list_size (&cache->partial) > 1) {
+		list_remove (&s->elem);
+		cache->slab_cnt--;
+		palloc_free_page (s);
+	}
+	lock_release (&cache->lock);
+}
+
+/* Prints per-cache utilization statistics. */
+void
+slab_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e)) {
+		struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+		size_t capacity = c->slab_cnt * c->objs_per_slab;
+
+		printf ("Slab %s: %zu/%zu objects of %zu bytes in use "
+				"(%zu%%), %zu slabs, %zu allocations\n",
+				c->name, c->in_use, capacity, c->obj_size,
+				capacity != 0 ? c->in_use * 100 / capacity : 0,
+				c->slab_cnt, c->alloc_cnt);
+	}
+}
+
+/* Returns the slab of CACHE that object OBJ is inside. */
+static struct slab *
+obj_to_slab (struct slab_cache *cache, void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	/* Check that the slab is valid and belongs to CACHE. */
+	ASSERT (s != NULL);
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (s->cache == cache);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT (pg_ofs (obj) >= cache->obj_ofs);
+	ASSERT ((pg_ofs (obj) - cache->obj_ofs) % cache->obj_size == 0);
+
+	return s;
+}
+
+/* Returns the IDX'th object within slab S of CACHE. */
+static void *
+slab_to_obj (struct slab_cache *cache, struct slab *s, size_t idx) {
+	ASSERT (s != NULL);
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (idx < cache->objs_per_slab);
+	return (uint8_t *) s + cache->obj_ofs + idx * cache->obj_size;
+}
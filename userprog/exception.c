@@ -145,7 +145,9 @@ page_fault (struct intr_frame *f) {
 	if (vm_try_handle_fault (f, fault_addr, user, write, not_present))
 		return;
 #endif
-	if (not_present || user) 
+	/* A kernel access to user memory on behalf of a system call, e.g.
+	   read() into a read-only page, is the process's fault. */
+	if (not_present || user || is_user_vaddr (fault_addr))
 	{
 		set_code_and_exit(-1);
 	}
@@ -7,12 +7,14 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/tss.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -24,6 +26,11 @@
 
 #include "threads/synch.h"
 
+/* Executable loading statistics, under LOAD_STATS_LOCK. */
+static uint64_t load_cnt;           /* Calls to load(). */
+static int64_t load_ticks;          /* Timer ticks spent in load(). */
+static struct lock load_stats_lock;
+
 static void process_cleanup (void);
 static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
@@ -45,6 +52,9 @@ process_create_initd (const char *file_name) {
 	char *fn_copy;
 	tid_t tid;
 
+	/* Every later load() comes from this process or its children. */
+	lock_init (&load_stats_lock);
+
 	/* Make a copy of FILE_NAME.
 	 * Otherwise there's a race between the caller and load(). */
 	fn_copy = palloc_get_page (0);
@@ -335,6 +345,10 @@ process_exit (void) {
 	// 		sema_up(thread_current()->parent->wait_sema);
 	// }
 	
+#ifdef VM
+	if (curr->pml4 != NULL)
+		vm_record_exit (&curr->spt);
+#endif
 	process_cleanup ();
 }
 
@@ -344,7 +358,9 @@ process_cleanup (void) {
 	struct thread *curr = thread_current ();
 
 #ifdef VM
-	supplemental_page_table_kill (&curr->spt);
+	/* Kernel threads never set up an spt. */
+	if (curr->pml4 != NULL)
+		supplemental_page_table_kill (&curr->spt);
 #endif
 
 	uint64_t *pml4;
@@ -376,6 +392,13 @@ process_activate (struct thread *next) {
 	tss_update (next);
 }
 
+/* Prints executable loading statistics. */
+void
+process_print_stats (void) {
+	printf ("Exec: %"PRIu64" loads in %"PRId64" ticks\n",
+			load_cnt, load_ticks);
+}
+
 /* We load ELF binaries.  The following definitions are taken
  * from the ELF specification, [ELF1], more-or-less verbatim.  */
 
@@ -444,7 +467,11 @@ load (const char *file_name, struct intr_frame *if_) {
 	struct thread *t = thread_current ();
 	struct ELF ehdr;
 	struct file *file = NULL;
-	off_t file_ofs;
+	uint8_t *head = NULL;
+	off_t head_len;
+	struct Phdr *phdrs, *phdrs_buf = NULL;
+	size_t phdrs_size;
+	int64_t start = timer_ticks ();
 	bool success = false;
 	int i;
 
@@ -474,8 +501,16 @@ load (const char *file_name, struct intr_frame *if_) {
 		printf ("load: %s: open failed\n", file_name);
 		goto done;
 	}
-	/* Read and verify executable header. */
-	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+	/* Read the executable header and, usually, the program headers
+	 * that follow it with a single read. */
+	head = palloc_get_page (PAL_ZERO);
+	if (head == NULL)
+		goto done;
+	head_len = file_read_at (file, head, PGSIZE, 0);
+	memcpy (&ehdr, head, sizeof ehdr);
+
+	/* Verify executable header. */
+	if (head_len < (off_t) sizeof ehdr
 			|| memcmp (ehdr.e_ident, "\177ELF\2\1\1", 7)
 			|| ehdr.e_type != 2
 			|| ehdr.e_machine != 0x3E // amd64
@@ -486,18 +521,22 @@ load (const char *file_name, struct intr_frame *if_) {
 		goto done;
 	}
 
-	/* Read program headers. */
-	file_ofs = ehdr.e_phoff;
-	for (i = 0; i < ehdr.e_phnum; i++) {
-		struct Phdr phdr;
-
-		if (file_ofs < 0 || file_ofs > file_length (file))
+	/* Read program headers, unless they came with the header. */
+	phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+	if (ehdr.e_phoff > (uint64_t) file_length (file))
+		goto done;
+	if (ehdr.e_phoff + phdrs_size <= (uint64_t) head_len)
+		phdrs = (struct Phdr *) (head + ehdr.e_phoff);
+	else {
+		phdrs = phdrs_buf = malloc (phdrs_size);
+		if (phdrs == NULL
+				|| file_read_at (file, phdrs, phdrs_size, ehdr.e_phoff)
+				!= (off_t) phdrs_size)
 			goto done;
-		file_seek (file, file_ofs);
+	}
+	for (i = 0; i < ehdr.e_phnum; i++) {
+		struct Phdr phdr = phdrs[i];
 
-		if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-			goto done;
-		file_ofs += sizeof phdr;
 		switch (phdr.p_type) {
 			case PT_NULL:
 			case PT_NOTE:
@@ -581,6 +620,12 @@ done:
 	// file_close (file);
 	if (!success)
 		file_close (file);
+	free (phdrs_buf);
+	palloc_free_page (head);
+	lock_acquire (&load_stats_lock);
+	load_cnt++;
+	load_ticks += timer_elapsed (start);
+	lock_release (&load_stats_lock);
 	return success;
 }
 
@@ -733,65 +778,27 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-struct info_binary{
-	struct file *file;
-	off_t ofs;
-	uint8_t *upage;
-	uint32_t read_bytes;
-	uint32_t zero_bytes;
-	bool writable;
-};
+/* Most pages load_segment() reads in with one read. */
+#define LOAD_PREFETCH_PAGES 16
 
 static bool
 lazy_load_segment (struct page *page, void *aux) {
 	/* TODO: Load the segment from the file */
 	/* TODO: This called when the first page fault occurs on address VA. */
 	/* TODO: VA is available when calling this function. */
-
-	struct file *file = ((struct info_binary *)aux)->file;
-	off_t ofs = ((struct info_binary *)aux)->ofs;
-	uint32_t read_bytes = ((struct info_binary *)aux)->read_bytes;
-	uint32_t zero_bytes = ((struct info_binary *)aux)->zero_bytes;
-	bool writable = ((struct info_binary *)aux)->writable;
-	// printf("read_bytes: %d\n", read_bytes);
-	// ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
-	// ASSERT (pg_ofs (page) == 0);
-	// ASSERT (ofs % PGSIZE == 0);
-
-	file_seek (file, ofs);
-	// while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* Get a page of memory. */
-		// uint8_t *kpage = palloc_get_page (PAL_USER);
-		// if (kpage == NULL)
-		// 	return false;
-		// struct frame *frame = vm_get_frame();
-		/* Load this page. */
-		if (file_read (file, page->frame->kva, page_read_bytes ) != (int) page_read_bytes ) {
-			palloc_free_page (page);
-			return false;
-		}
-		memset (page->frame->kva + page_read_bytes, 0, page_zero_bytes);
-
-		/* Add the page to the process's address space. */
-		// struct supplemental_page_table *spt = &thread_current()->spt;
-		// if (!spt_insert_page(spt, page)) {
-		// 	printf("fail\n");
-		// 	palloc_free_page (page);
-		// 	return false;
-		// }
-	
-		/* Advance. */
-		// read_bytes -= page_read_bytes;
-		// zero_bytes -= page_zero_bytes;
-		// page += PGSIZE;
-	// }
-	return true;
+	struct lazy_aux *info = aux;
+	void *kva = page->frame->kva;
+	bool success = true;
+
+	/* Read at an explicit offset; load() owns the file position. */
+	if (file_read_at (info->file, kva, info->read_bytes, info->ofs)
+			!= (off_t) info->read_bytes)
+		success = false;
+	else
+		memset (kva + info->read_bytes, 0, info->zero_bytes);
+
+	free (aux);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -816,35 +823,24 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		struct info_binary *info = malloc(sizeof(struct info_binary));
-		info->file = file;
-		info->ofs = ofs;
-		info->upage = upage;
-		info->read_bytes = page_read_bytes;
-		info->zero_bytes = page_zero_bytes;
-		info->writable = writable;
-		aux = info;
-
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-		{
-			return false;
-		}
+	/* TODO: Set up aux to pass information to the lazy_load_segment. */
+	/* The segment is recorded as one area; vma_populate() builds the aux
+	 * of each page when it is first faulted. */
+	if (vma_map (&thread_current ()->spt, VM_ANON, upage,
+			(read_bytes + zero_bytes) / PGSIZE, writable, file, ofs,
+			read_bytes, lazy_load_segment) == NULL)
+		return false;
 
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-		ofs += page_read_bytes;
+	/* Stream the file data in now, LOAD_PREFETCH_PAGES at a time, rather
+	 * than a page per fault.  A page that vm_prefetch() stops at, such
+	 * as one whose text another process has loaded already, is skipped
+	 * and left to load lazily, and streaming goes on after it. */
+	while (read_bytes > 0) {
+		size_t cnt = vm_prefetch (upage, LOAD_PREFETCH_PAGES);
+		if (cnt == 0)
+			cnt = 1;
+		upage += cnt * PGSIZE;
+		read_bytes -= read_bytes < cnt * PGSIZE ? read_bytes : cnt * PGSIZE;
 	}
 	return true;
 }
@@ -860,9 +856,9 @@ setup_stack (struct intr_frame *if_) {
 	 * TODO: You should mark the page is stack. */
 	/* TODO: Your code goes here */
 	
-	vm_alloc_page_with_initializer(VM_ANON | VM_MARKER_0, stack_bottom, true, NULL, NULL);
-
-	if (vm_claim_page(stack_bottom)){
+	if (vma_map (&thread_current ()->spt, VM_ANON | VM_MARKER_0, stack_bottom,
+				1, true, NULL, 0, 0, NULL) != NULL
+			&& vm_claim_page (stack_bottom)) {
 		if_->rsp = USER_STACK;
 		success = true;
 		// struct page* stack_page = spt_find_page(&thread_current()->spt, stack_bottom);
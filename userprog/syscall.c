@@ -10,18 +10,28 @@
 
 #include <string.h>
 #include "threads/palloc.h"
+#include "filesys/buffer_cache.h"
+#ifdef EFILESYS
+#include "filesys/page_cache.h"
+#endif
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include <console.h>
 #include "devices/input.h"
 #include "userprog/process.h"
 #include "threads/synch.h"
+#ifdef VM
+#include "vm/vm.h"
+#include "vm/madvise.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
 void set_code_and_exit(int exit_code);
 bool check_valid_mem(void* ptr);
 bool check_valid_fd(int fd);
+static int file_io(struct file *file, void *buffer, unsigned size,
+		bool write);
 
 /* System call.
  *
@@ -38,6 +48,9 @@ bool check_valid_fd(int fd);
 
 struct lock lock;
 
+/* Most bytes of a user buffer that read and write pin at once. */
+#define IO_CHUNK_SIZE (16 * PGSIZE)
+
 void
 syscall_init (void) {
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
@@ -192,9 +205,11 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		{
 			struct file* read_file 
 					= (struct file*)(thread_current()->fd_table[fd]);
-			f->R.rax = file_read(read_file, buffer, size);
+			f->R.rax = file_io(read_file, buffer, size, false);
 		}
 		lock_release(&lock);	
+		if ((int) f->R.rax < 0)
+			set_code_and_exit(-1);
 		break;
 	}
 	case SYS_WRITE: {                /* Write to a file. */
@@ -223,11 +238,13 @@ syscall_handler (struct intr_frame *f UNUSED) {
 			
 			struct file* write_file 
 					= (struct file*)(thread_current()->fd_table[fd]);
-			f->R.rax = file_write(write_file, buffer, size);
+			f->R.rax = file_io(write_file, buffer, size, true);
 			
 			// palloc_free_page (contents);	
 		}
 		lock_release(&lock);	
+		if ((int) f->R.rax < 0)
+			set_code_and_exit(-1);
 		break;
 	}
 	case SYS_SEEK:                   /* Change position in a file. */
@@ -260,6 +277,72 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	
 		break;
 	}
+	case SYS_FSYNC:                  /* Write a file's data to disk. */
+	{
+		int fd = f->R.rdi;
+
+		/* The cache does not know which sectors belong to which
+		   file, so this writes back everything. */
+		if (fd < 2 || !check_valid_fd(fd)) {
+			f->R.rax = -1;
+			break;
+		}
+#ifdef EFILESYS
+		page_cache_flush();
+#endif
+		buffer_cache_flush();
+		f->R.rax = 0;
+		break;
+	}
+
+#ifdef VM
+	case SYS_MMAP:                   /* Map a file into memory. */
+	{
+		void *addr = (void *) f->R.rdi;
+		size_t length = f->R.rsi;
+		int writable = f->R.rdx;
+		int fd = f->R.r10;
+		off_t offset = f->R.r8;
+
+		/* Descriptors 0 and 1 are the console, not files. */
+		if (fd < 2 || !check_valid_fd(fd)) {
+			f->R.rax = (uint64_t) NULL;
+			break;
+		}
+
+		lock_acquire(&lock);
+		f->R.rax = (uint64_t) do_mmap(addr, length, writable,
+				thread_current()->fd_table[fd], offset);
+		lock_release(&lock);
+		break;
+	}
+	case SYS_MUNMAP:                 /* Remove a memory mapping. */
+	{
+		void *addr = (void *) f->R.rdi;
+
+		lock_acquire(&lock);
+		do_munmap(addr);
+		lock_release(&lock);
+		break;
+	}
+	case SYS_MEMSTAT:                /* Report the caller's memory usage. */
+	{
+		f->R.rax = vm_memstat(f->R.rdi);
+		break;
+	}
+	case SYS_MADVISE:                /* Give advice about memory use. */
+	{
+		f->R.rax = do_madvise((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	}
+	case SYS_MLOCK:                  /* Lock pages in memory. */
+	case SYS_MUNLOCK:                /* Unlock pages. */
+	{
+		f->R.rax = do_mlock((void *) f->R.rdi, f->R.rsi,
+				f->R.rax == SYS_MLOCK);
+		break;
+	}
+#endif
 
 	default:
 	{
@@ -267,9 +350,6 @@ syscall_handler (struct intr_frame *f UNUSED) {
     	break;
 	}
 
-	// /* Project 3 and optionally project 4. */
-	// SYS_MMAP,                   /* Map a file into memory. */
-	// SYS_MUNMAP,                 /* Remove a memory mapping. */
 
 	// /* Project 4 only. */
 	// SYS_CHDIR,                  /* Change the current directory. */
@@ -287,11 +367,51 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	}
 }
 
+/* Reads SIZE bytes from FILE into user BUFFER, or writes them from
+ * BUFFER to FILE if WRITE is true, and returns the number of bytes
+ * transferred.  The I/O goes straight to and from user memory, a chunk
+ * at a time with the pages of the chunk pinned, so that a large transfer
+ * neither faults with the file system busy nor pins too much memory at
+ * once.  Returns -1 if BUFFER is not valid user memory. */
+static int
+file_io(struct file *file, void *buffer, unsigned size, bool write)
+{
+	int done = 0;
+
+	while (size > 0) {
+		unsigned chunk = size < IO_CHUNK_SIZE ? size : IO_CHUNK_SIZE;
+		off_t n;
+
+#ifdef VM
+		if (!vm_pin_buffer(buffer, chunk, !write))
+			return -1;
+#endif
+		n = write ? file_write(file, buffer, chunk)
+			: file_read(file, buffer, chunk);
+#ifdef VM
+		vm_unpin_buffer(buffer, chunk);
+#endif
+		done += n;
+		if ((unsigned) n < chunk)
+			break;
+		buffer = (uint8_t *) buffer + n;
+		size -= n;
+	}
+	return done;
+}
+
 bool 
 check_valid_mem(void* ptr){
-	if (ptr == NULL || !is_user_vaddr (ptr) || pml4_get_page(thread_current()->pml4, ptr) == NULL)
+	if (ptr == NULL || !is_user_vaddr (ptr))
 		return false;
-	return true;
+	if (pml4_get_page(thread_current()->pml4, ptr) != NULL)
+		return true;
+#ifdef VM
+	/* Not resident yet, but the page fault handler can bring it in. */
+	if (vma_find(&thread_current()->spt, ptr) != NULL)
+		return true;
+#endif
+	return false;
 }
 
 void
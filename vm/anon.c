@@ -1,7 +1,19 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include "vm/ksm.h"
+#include "vm/zswap.h"
 #include "devices/disk.h"
+#include <bitmap.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of swap disk sectors that hold one page. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,37 +29,171 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* One bit per page-sized slot of the swap disk; true means in use. */
+static struct bitmap *swap_table;
+static struct lock swap_lock;
+
+/* Statistics. */
+static uint64_t zswap_in_cnt;       /* Pages swapped in from zswap. */
+static uint64_t disk_in_cnt;        /* Pages swapped in from the disk. */
+static uint64_t disk_out_cnt;       /* Pages written to the disk. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
 	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	swap_table = bitmap_create (swap_disk != NULL
+			? disk_size (swap_disk) / SECTORS_PER_PAGE : 0);
+	if (swap_table == NULL)
+		PANIC ("cannot allocate swap table");
+	lock_init (&swap_lock);
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
+	/* An initializer, if any, fills the whole page itself; only pure
+	 * zero pages need clearing.  Read it before the union is reused. */
+	bool has_contents = page->uninit.init != NULL;
+
 	struct anon_page *anon_page = &page->anon;
+	anon_page->swap_slot = SWAP_SLOT_NONE;
+	anon_page->shared = NULL;
+	anon_page->zswap = NULL;
+	if (!has_contents)
+		memset (kva, 0, PGSIZE);
+	return true;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = anon_page->swap_slot;
+
+	if (anon_page->shared != NULL) {
+		/* Written to after ksmd merged it: take a private copy. */
+		memcpy (kva, anon_page->shared->kva, PGSIZE);
+		ksm_put (anon_page->shared);
+		anon_page->shared = NULL;
+		return true;
+	}
+	if (anon_page->zswap != NULL) {
+		zswap_load (anon_page->zswap, kva);
+		anon_page->zswap = NULL;
+		zswap_in_cnt++;
+		return true;
+	}
+	if (slot == SWAP_SLOT_NONE)
+		return false;
+
+	for (size_t i = 0; i < SECTORS_PER_PAGE; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_PAGE + i,
+				kva + i * DISK_SECTOR_SIZE);
+
+	lock_acquire (&swap_lock);
+	bitmap_reset (swap_table, slot);
+	lock_release (&swap_lock);
+	anon_page->swap_slot = SWAP_SLOT_NONE;
+	disk_in_cnt++;
+	return true;
+}
+
+/* Reserves CNT consecutive swap slots and returns the first one, or
+ * SWAP_SLOT_NONE if there is no such run.  The caller hands them out
+ * by setting the swap_slot of resident pages it is about to swap out,
+ * so that a batch of pages is written to one stretch of the disk. */
+size_t
+anon_reserve_slots (size_t cnt) {
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_and_flip (swap_table, 0, cnt, false);
+	lock_release (&swap_lock);
+	return slot != BITMAP_ERROR ? slot : SWAP_SLOT_NONE;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by writing contents to the swap disk, unless zswap
+ * takes it. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	uint64_t *pml4 = page->owner->pml4;
+	void *kva = page->frame->kva;
+	size_t slot = anon_page->swap_slot;
+
+	/* Unmap first so the owner cannot change the page behind our back. */
+	pml4_clear_page (pml4, page->va);
+
+	anon_page->zswap = zswap_store (kva);
+	if (anon_page->zswap != NULL) {
+		/* Drop a slot that anon_reserve_slots() handed out. */
+		if (slot != SWAP_SLOT_NONE) {
+			lock_acquire (&swap_lock);
+			bitmap_reset (swap_table, slot);
+			lock_release (&swap_lock);
+			anon_page->swap_slot = SWAP_SLOT_NONE;
+		}
+		return true;
+	}
+
+	/* A resident page only has a slot if anon_reserve_slots() gave it
+	 * one. */
+	if (slot == SWAP_SLOT_NONE) {
+		lock_acquire (&swap_lock);
+		slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+		lock_release (&swap_lock);
+		if (slot == BITMAP_ERROR) {
+			/* Stays resident; the page table already exists. */
+			pml4_set_page (pml4, page->va, kva, page->writable);
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < SECTORS_PER_PAGE; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_PAGE + i,
+				kva + i * DISK_SECTOR_SIZE);
+
+	anon_page->swap_slot = slot;
+	disk_out_cnt++;
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	palloc_free_page(anon_page);
+	struct frame *frame = vm_detach_frame (page);
+
+	if (frame != NULL)
+		vm_free_frame (frame);
+	if (anon_page->shared != NULL) {
+		/* Keep pml4_destroy() from freeing the shared frame. */
+		pml4_clear_page (page->owner->pml4, page->va);
+		ksm_put (anon_page->shared);
+	}
+	if (anon_page->zswap != NULL)
+		zswap_free (anon_page->zswap);
+	if (anon_page->swap_slot != SWAP_SLOT_NONE) {
+		lock_acquire (&swap_lock);
+		bitmap_reset (swap_table, anon_page->swap_slot);
+		lock_release (&swap_lock);
+	}
+}
+
+/* Prints swap statistics. */
+void
+vm_anon_print_stats (void) {
+	uint64_t in_cnt = zswap_in_cnt + disk_in_cnt;
+
+	printf ("Swap: %"PRIu64" pages in, %"PRIu64"%% from zswap; "
+			"%"PRIu64" pages written to disk\n",
+			in_cnt, in_cnt != 0 ? zswap_in_cnt * 100 / in_cnt : 0,
+			disk_out_cnt);
+	zswap_print_stats ();
 }
@@ -1,10 +1,17 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static bool lazy_load_file (struct page *page, void *aux);
+static void write_back (struct page *page);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -21,39 +28,151 @@ vm_file_init (void) {
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
+	/* The aux overlaps page->file in the union, so fetch it first. */
+	struct lazy_aux *aux = page->uninit.aux;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->file = aux->file;
+	file_page->ofs = aux->ofs;
+	file_page->read_bytes = aux->read_bytes;
+	file_page->zero_bytes = aux->zero_bytes;
+#ifdef EFILESYS
+	file_page->cache = NULL;
+#endif
+	return true;
+}
+
+#ifdef EFILESYS
+/* Returns true if PAGE, a page of a file mapping, holds file data.
+ * Such a page is mapped to the page cache's frame for its part of the
+ * file instead of having a frame of its own. */
+bool
+file_backed_cached (struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return ((struct lazy_aux *) page->uninit.aux)->read_bytes > 0;
+	return page->file.read_bytes > 0;
+}
+
+/* Maps PAGE, for which file_backed_cached() is true, to the page
+ * cache. */
+bool
+file_backed_map (struct page *page) {
+	struct file_page *file_page = &page->file;
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		struct lazy_aux *aux = page->uninit.aux;
+
+		/* The loader never runs, so its aux goes now. */
+		file_backed_initializer (page, VM_FILE, NULL);
+		free (aux);
+	}
+	return page_cache_map (page, file_get_inode (file_page->file),
+			file_page->ofs, page->writable);
+}
+#endif
+
+/* Fills the first fault of a mapped page, then releases the aux that
+ * described it. */
+static bool
+lazy_load_file (struct page *page, void *aux) {
+	bool success = file_backed_swap_in (page, page->frame->kva);
+	free (aux);
+	return success;
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_read_at (file_page->file, kva, file_page->read_bytes,
+				file_page->ofs) != (off_t) file_page->read_bytes)
+		return false;
+	memset (kva + file_page->read_bytes, 0, file_page->zero_bytes);
+	return true;
+}
+
+/* Writes PAGE back to its file if the user modified it, and clears the
+ * dirty bit.  Clean pages are never written. */
+static void
+write_back (struct page *page) {
+	struct file_page *file_page = &page->file;
+	uint64_t *pml4 = page->owner->pml4;
+
+	if (pml4_is_dirty (pml4, page->va)) {
+		file_write_at (file_page->file, page->frame->kva,
+				file_page->read_bytes, file_page->ofs);
+		pml4_set_dirty (pml4, page->va, false);
+	}
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	/* Unmap first; the dirty bit survives pml4_clear_page(). */
+	pml4_clear_page (page->owner->pml4, page->va);
+	write_back (page);
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
-	palloc_free_page(file_page);
+	struct frame *frame;
+
+#ifdef EFILESYS
+	/* Changes made through a page cache mapping stay in the cache. */
+	page_cache_unmap (page);
+#endif
+	frame = vm_detach_frame (page);
+
+	if (frame != NULL) {
+		pml4_clear_page (page->owner->pml4, page->va);
+		write_back (page);
+		vm_free_frame (frame);
+	}
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	off_t file_len;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || offset % PGSIZE != 0
+			|| length == 0 || offset < 0)
+		return NULL;
+	if (is_kernel_vaddr (addr) || (uint64_t) addr + length < (uint64_t) addr
+			|| is_kernel_vaddr ((uint64_t) addr + length - 1))
+		return NULL;
+
+	file_len = file_length (file);
+	if (file_len == 0 || offset >= file_len)
+		return NULL;
+
+	/* Only the bytes of the file covered by LENGTH are mapped; the tail
+	 * of the last page reads as zeros and is never written back. */
+	size_t read_bytes = file_len - offset < (off_t) length
+		? (size_t) (file_len - offset) : length;
+	if (vma_map (spt, VM_FILE, addr, DIV_ROUND_UP (length, PGSIZE),
+				writable, file, offset, read_bytes, lazy_load_file) == NULL)
+		return NULL;
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_area *vma = vma_find (spt, addr);
+
+	if (vma == NULL || vma->start != addr || VM_TYPE (vma->type) != VM_FILE)
+		return;
+	vma_unmap (spt, vma);
 }
@@ -0,0 +1,232 @@
+/* ksm.c: Merging of anonymous pages with identical contents.
+
+   ksmd is a low-priority kernel thread that wakes up every
+   KSM_SLEEP_TICKS and examines the next ksm_pages_to_scan frames of
+   the frame table.  Each anonymous page it meets is write-protected,
+   so that its contents hold still, and checksummed.  If the "stable"
+   table already has a shared frame with that checksum and memcmp()
+   confirms the contents match, the page is remapped read-only to the
+   shared frame and its own frame is freed.  Otherwise the page is
+   matched against the other candidates of the same pass, and a pair of
+   identical pages is merged by turning one of their frames into a new
+   shared frame.
+
+   A write to a merged page faults like a write to the zero frame:
+   vm_handle_wp() drops the mapping and vm_do_claim_page() brings the
+   page back through anon_swap_in(), which copies the shared contents
+   into a private frame and releases its reference.  Shared frames are
+   not in the frame table, so merged pages stay in memory. */
+
+#include "vm/ksm.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Timer ticks between two passes of ksmd. */
+#define KSM_SLEEP_TICKS (TIMER_FREQ / 10)
+
+/* Frames examined per pass. */
+size_t ksm_pages_to_scan = 64;
+
+/* Shared frames, by checksum. */
+static struct hash stable;
+/* Protects STABLE, the reference counts and the statistics. */
+static struct lock ksm_lock;
+
+/* Statistics. */
+static size_t pages_shared;     /* Shared frames in use. */
+static size_t pages_sharing;    /* Pages mapped to a shared frame. */
+static uint64_t pages_scanned;  /* Anonymous pages examined. */
+
+/* A page examined during the current pass. */
+struct ksm_candidate {
+	struct frame *frame;        /* Its frame, or NULL once merged. */
+	uint64_t checksum;          /* hash_bytes() of its contents. */
+};
+
+/* State of one pass of ksmd over the frame table. */
+struct ksm_pass {
+	struct ksm_candidate *cands;
+	size_t cand_cnt;
+};
+
+static void ksmd (void *aux);
+static void ksm_visit (struct frame *, void *pass);
+
+/* Returns a hash value for shared frame E. */
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct ksm_frame, elem)->checksum;
+}
+
+/* Returns true if shared frame A's checksum precedes B's. */
+static bool
+ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct ksm_frame, elem)->checksum
+		< hash_entry (b, struct ksm_frame, elem)->checksum;
+}
+
+/* Initializes page merging and starts ksmd, unless disabled. */
+void
+ksm_init (void) {
+	hash_init (&stable, ksm_hash, ksm_less, NULL);
+	lock_init (&ksm_lock);
+	if (ksm_pages_to_scan > 0)
+		thread_create ("ksmd", PRI_MIN, ksmd, NULL);
+}
+
+/* Drops one page's reference to shared frame KF, freeing it when the
+ * last one is gone. */
+void
+ksm_put (struct ksm_frame *kf) {
+	lock_acquire (&ksm_lock);
+	pages_sharing--;
+	if (--kf->ref_cnt == 0) {
+		hash_delete (&stable, &kf->elem);
+		pages_shared--;
+		palloc_free_page (kf->kva);
+		free (kf);
+	}
+	lock_release (&ksm_lock);
+}
+
+/* Prints page merging statistics. */
+void
+ksm_print_stats (void) {
+	printf ("KSM: %zu shared frames, %zu pages sharing, "
+			"%"PRIu64" pages scanned\n",
+			pages_shared, pages_sharing, pages_scanned);
+}
+
+/* The merging thread. */
+static void
+ksmd (void *aux UNUSED) {
+	for (;;) {
+		struct ksm_pass pass;
+
+		timer_sleep (KSM_SLEEP_TICKS);
+
+		pass.cands = malloc (ksm_pages_to_scan * sizeof *pass.cands);
+		if (pass.cands == NULL)
+			continue;
+		pass.cand_cnt = 0;
+		vm_scan_frames (ksm_pages_to_scan, ksm_visit, &pass);
+		free (pass.cands);
+	}
+}
+
+/* Maps PAGE read-only to KVA, keeping its accessed bit. */
+static void
+write_protect (struct page *page, void *kva) {
+	uint64_t *pml4 = page->owner->pml4;
+	bool accessed = pml4_is_accessed (pml4, page->va);
+
+	/* The page is mapped already, so no page table is allocated. */
+	pml4_set_page (pml4, page->va, kva, false);
+	if (accessed)
+		pml4_set_accessed (pml4, page->va, true);
+}
+
+/* Moves PAGE, resident in FRAME, over to shared frame KF and frees
+ * FRAME. */
+static void
+ksm_merge (struct page *page, struct frame *frame, struct ksm_frame *kf) {
+	void *kva = vm_steal_frame (frame);
+
+	write_protect (page, kf->kva);
+	page->anon.shared = kf;
+	palloc_free_page (kva);
+}
+
+/* Returns the shared frame with CHECKSUM, or NULL. */
+static struct ksm_frame *
+stable_find (uint64_t checksum) {
+	struct ksm_frame key;
+	struct hash_elem *e;
+
+	key.checksum = checksum;
+	e = hash_find (&stable, &key.elem);
+	return e != NULL ? hash_entry (e, struct ksm_frame, elem) : NULL;
+}
+
+/* Examines FRAME for merging during PASS.  Called by vm_scan_frames()
+ * with the frame table locked, so no frame of PASS can be evicted or
+ * written to while it runs. */
+static void
+ksm_visit (struct frame *frame, void *pass_) {
+	struct ksm_pass *pass = pass_;
+	struct page *page = frame->page;
+	struct ksm_frame *kf;
+	uint64_t checksum;
+	size_t i;
+
+	if (page == NULL || page->operations->type != VM_ANON
+			|| frame->pin_cnt > 0)
+		return;
+	/* Write-protecting one page would split a whole huge mapping. */
+	if (pml4_is_huge (page->owner->pml4, page->va))
+		return;
+
+	write_protect (page, frame->kva);
+	checksum = hash_bytes (frame->kva, PGSIZE);
+
+	lock_acquire (&ksm_lock);
+	pages_scanned++;
+	kf = stable_find (checksum);
+	if (kf != NULL && !memcmp (kf->kva, frame->kva, PGSIZE)) {
+		kf->ref_cnt++;
+		pages_sharing++;
+		lock_release (&ksm_lock);
+		ksm_merge (page, frame, kf);
+		return;
+	}
+	lock_release (&ksm_lock);
+
+	/* A different page already owns this checksum; leave it be. */
+	if (kf != NULL)
+		return;
+
+	for (i = 0; i < pass->cand_cnt; i++) {
+		struct ksm_candidate *c = &pass->cands[i];
+		struct page *other;
+
+		if (c->frame == NULL || c->frame == frame || c->checksum != checksum
+				|| memcmp (c->frame->kva, frame->kva, PGSIZE))
+			continue;
+
+		/* Turn the other page's frame into a shared one. */
+		kf = malloc (sizeof *kf);
+		if (kf == NULL)
+			return;
+		other = c->frame->page;
+		kf->kva = vm_steal_frame (c->frame);
+		kf->checksum = checksum;
+		kf->ref_cnt = 2;
+		other->anon.shared = kf;
+		c->frame = NULL;
+
+		lock_acquire (&ksm_lock);
+		hash_insert (&stable, &kf->elem);
+		pages_shared++;
+		pages_sharing += 2;
+		lock_release (&ksm_lock);
+
+		ksm_merge (page, frame, kf);
+		return;
+	}
+
+	if (pass->cand_cnt < ksm_pages_to_scan)
+		pass->cands[pass->cand_cnt++] = (struct ksm_candidate) {
+			.frame = frame,
+			.checksum = checksum,
+		};
+}
@@ -0,0 +1,84 @@
+/* kswapd.c: Background page-out.
+
+   Evicting a page on the faulting thread puts swap and file writes on
+   the path of every fault once memory is full.  kswapd keeps a reserve
+   of free user frames instead.  vm_get_frame() pokes it whenever the
+   number of free frames drops below the low watermark, and it evicts
+   pages in batches through vm_reclaim() until the number is back above
+   the high watermark.  Faults then find a free frame right away, and
+   only evict a page themselves when kswapd cannot keep up. */
+
+#include "vm/kswapd.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Watermarks, in free user frames. */
+static size_t low_wmark;
+static size_t high_wmark;
+
+/* Frames evicted per vm_reclaim() call. */
+#define KSWAPD_BATCH 16
+
+static struct semaphore kswapd_sema;
+static bool kswapd_awake;
+
+/* Statistics. */
+static uint64_t wakeup_cnt;         /* Times kswapd was poked. */
+static uint64_t reclaim_cnt;        /* Frames it freed. */
+
+static void kswapd (void *aux);
+
+/* Sets the watermarks from the size of the user pool and starts
+ * kswapd.  Must be called before any user frame is allocated. */
+void
+kswapd_init (void) {
+	size_t frame_cnt = palloc_free_cnt (PAL_USER);
+
+	low_wmark = frame_cnt / 64;
+	if (low_wmark < KSWAPD_BATCH / 2)
+		low_wmark = KSWAPD_BATCH / 2;
+	high_wmark = 2 * low_wmark;
+
+	sema_init (&kswapd_sema, 0);
+	kswapd_awake = false;
+	thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL);
+}
+
+/* Wakes kswapd up if free user frames are running low. */
+void
+kswapd_poke (void) {
+	if (!kswapd_awake && palloc_free_cnt (PAL_USER) < low_wmark) {
+		kswapd_awake = true;
+		wakeup_cnt++;
+		sema_up (&kswapd_sema);
+	}
+}
+
+/* Prints background page-out statistics. */
+void
+kswapd_print_stats (void) {
+	printf ("kswapd: %"PRIu64" wakeups, %"PRIu64" frames reclaimed, "
+			"watermarks %zu/%zu\n",
+			wakeup_cnt, reclaim_cnt, low_wmark, high_wmark);
+}
+
+/* The page-out thread. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&kswapd_sema);
+
+		while (palloc_free_cnt (PAL_USER) < high_wmark) {
+			size_t freed = vm_reclaim (KSWAPD_BATCH);
+			if (freed == 0)
+				break;
+			reclaim_cnt += freed;
+		}
+		kswapd_awake = false;
+	}
+}
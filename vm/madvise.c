@@ -0,0 +1,140 @@
+/* madvise.c: Memory hints from user programs.
+
+   madvise() records how a process is going to use a range of memory,
+   or acts on it right away:
+
+   - MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL are kept in each area
+     the range touches and size the fault-around of file-backed areas:
+     a few pages by default, none for random access, and a larger
+     read-ahead for sequential access.
+
+   - MADV_WILLNEED reads the file data of the range in with large reads
+     and brings swapped-out pages back.
+
+   - MADV_DONTNEED evicts the resident pages of the range now, instead
+     of waiting for the clock to get to them.  Their contents are kept.
+
+   mlock() brings every page of a range in and keeps the clock from
+   evicting it until munlock().  Locks are not inherited by fork(). */
+
+#include "vm/madvise.h"
+#include <round.h>
+#include <syscall-nr.h>
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Most pages MADV_WILLNEED reads in with one read. */
+#define WILLNEED_BATCH 16
+
+/* Checks that [ADDR, ADDR + LENGTH) is a nonempty user range whose
+ * pages all belong to areas of the current process, and stores its page
+ * boundaries into *START and *END.  Returns false otherwise. */
+static bool
+get_range (void *addr, size_t length, uint8_t **start, uint8_t **end) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *va;
+
+	if (addr == NULL || length == 0
+			|| (uint64_t) addr + length < (uint64_t) addr
+			|| !is_user_vaddr ((uint8_t *) addr + length - 1))
+		return false;
+	*start = pg_round_down (addr);
+	*end = (uint8_t *) ROUND_UP ((uint64_t) addr + length, PGSIZE);
+
+	for (va = *start; va < *end; ) {
+		struct vm_area *vma = vma_find (spt, va);
+		if (vma == NULL)
+			return false;
+		va = vma->end;
+	}
+	return true;
+}
+
+/* Brings in the pages of [START, END) that hold file data or were
+ * swapped out. */
+static void
+will_need (uint8_t *start, uint8_t *end) {
+	struct thread *t = thread_current ();
+	uint8_t *va = start;
+
+	while (va < end) {
+		size_t cnt = (end - va) / PGSIZE;
+		struct page *page;
+
+		cnt = vm_prefetch (va, cnt < WILLNEED_BATCH ? cnt : WILLNEED_BATCH);
+		if (cnt > 0) {
+			va += cnt * PGSIZE;
+			continue;
+		}
+		page = spt_find_page (&t->spt, va);
+		if (page != NULL && VM_TYPE (page->operations->type) == VM_ANON
+				&& pml4_get_page (t->pml4, va) == NULL)
+			vm_claim_page (va);
+		va += PGSIZE;
+	}
+}
+
+/* Gives ADVICE about [ADDR, ADDR + LENGTH) to the VM.  Returns 0 if
+ * successful, -1 if the range is not mapped or ADVICE is unknown. */
+int
+do_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *start, *end, *va;
+
+	if (pg_ofs (addr) != 0 || !get_range (addr, length, &start, &end))
+		return -1;
+
+	switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+		case MADV_SEQUENTIAL:
+			for (va = start; va < end; ) {
+				struct vm_area *vma = vma_find (spt, va);
+				vma->advice = advice;
+				va = vma->end;
+			}
+			return 0;
+		case MADV_WILLNEED:
+			will_need (start, end);
+			return 0;
+		case MADV_DONTNEED:
+			for (va = start; va < end; va += PGSIZE) {
+				struct page *page = spt_find_page (spt, va);
+				if (page != NULL)
+					vm_page_out (page);
+			}
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+/* Locks the pages of [ADDR, ADDR + LENGTH) in memory if LOCK is true,
+ * or unlocks them.  Returns 0 if successful, -1 if the range is not
+ * mapped or too many pages would be locked; pages locked before the
+ * failure stay locked. */
+int
+do_mlock (void *addr, size_t length, bool lock) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *start, *end, *va;
+
+	if (!get_range (addr, length, &start, &end))
+		return -1;
+
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (!lock) {
+			if (page != NULL)
+				vm_unlock_page (page);
+			continue;
+		}
+		if (page == NULL)
+			page = vma_populate (vma_find (spt, va), va);
+		if (page == NULL || !vm_lock_page (page))
+			return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,257 @@
+/* text.c: Executable pages shared between processes.
+
+   load() records each PT_LOAD segment as an area whose pages are read
+   from the executable on their first fault.  For a read-only segment,
+   the contents of a page depend only on the executable and the part
+   of it that the page covers, so processes running the same program
+   can map one frame.  text_claim() looks such a page up by (inode,
+   offset, length) in a table of frames, reads it from the file only if
+   no process has it yet, and maps it read-only.
+
+   Shared frames are not in the frame table, so they stay in memory
+   until the last page mapping them is destroyed.  A text page that
+   somehow loses its mapping gets a private copy through
+   text_swap_in(), like any other page. */
+
+#include "vm/vm.h"
+#include "vm/text.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+static bool text_swap_in (struct page *page, void *kva);
+static bool text_swap_out (struct page *page);
+static void text_destroy (struct page *page);
+
+static const struct page_operations text_ops = {
+	.swap_in = text_swap_in,
+	.swap_out = text_swap_out,
+	.destroy = text_destroy,
+	.type = VM_TEXT,
+};
+
+/* Shared frames, by (inode, offset, length). */
+static struct hash text_table;
+static struct lock text_lock;
+
+/* Statistics. */
+static size_t frame_cnt;            /* Shared frames in use. */
+static uint64_t load_cnt;           /* Pages read from an executable. */
+static uint64_t hit_cnt;            /* Pages mapped to an existing frame. */
+
+/* Returns a hash value for text frame E. */
+static uint64_t
+text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct text_frame *tf = hash_entry (e, struct text_frame, elem);
+	return hash_bytes (&tf->inode, sizeof tf->inode)
+		^ hash_int (tf->ofs) ^ hash_int (tf->read_bytes);
+}
+
+/* Returns true if text frame A precedes B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct text_frame *a = hash_entry (a_, struct text_frame, elem);
+	const struct text_frame *b = hash_entry (b_, struct text_frame, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	if (a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Initializes the text table. */
+void
+vm_text_init (void) {
+	hash_init (&text_table, text_hash, text_less, NULL);
+	lock_init (&text_lock);
+}
+
+/* Returns the shared frame for the page described by AUX, reading it
+ * in if it is not loaded yet, with a reference taken for the caller.
+ * If KVA is non-null it already holds the page's contents and is used
+ * instead of reading, or freed if the page is loaded already.  Returns
+ * NULL if memory or the file fails. */
+static struct text_frame *
+text_get (struct lazy_aux *aux, void *kva) {
+	struct text_frame key, *tf;
+	struct hash_elem *e;
+
+	key.inode = file_get_inode (aux->file);
+	key.ofs = aux->ofs;
+	key.read_bytes = aux->read_bytes;
+
+	lock_acquire (&text_lock);
+	e = hash_find (&text_table, &key.elem);
+	if (e != NULL) {
+		tf = hash_entry (e, struct text_frame, elem);
+		tf->ref_cnt++;
+		hit_cnt++;
+		lock_release (&text_lock);
+		if (kva != NULL)
+			palloc_free_page (kva);
+		return tf;
+	}
+
+	/* Read it with the lock held, so that it is read only once. */
+	tf = malloc (sizeof *tf);
+	if (tf == NULL)
+		goto fail;
+	*tf = key;
+	if (kva != NULL)
+		tf->kva = kva;
+	else {
+		tf->kva = palloc_get_page (PAL_USER);
+		if (tf->kva == NULL)
+			goto fail;
+		if (file_read_at (aux->file, tf->kva, aux->read_bytes, aux->ofs)
+				!= (off_t) aux->read_bytes) {
+			palloc_free_page (tf->kva);
+			goto fail;
+		}
+		memset (tf->kva + aux->read_bytes, 0, PGSIZE - aux->read_bytes);
+	}
+	tf->ref_cnt = 1;
+	hash_insert (&text_table, &tf->elem);
+	frame_cnt++;
+	load_cnt++;
+	lock_release (&text_lock);
+	return tf;
+
+fail:
+	free (tf);
+	lock_release (&text_lock);
+	return NULL;
+}
+
+/* Drops one page's reference to TF, freeing it with the last one. */
+static void
+text_put (struct text_frame *tf) {
+	lock_acquire (&text_lock);
+	if (--tf->ref_cnt == 0) {
+		hash_delete (&text_table, &tf->elem);
+		frame_cnt--;
+		palloc_free_page (tf->kva);
+		free (tf);
+	}
+	lock_release (&text_lock);
+}
+
+/* Returns true if the page at offset OFS of FILE, with READ_BYTES bytes
+ * of data, is loaded already. */
+bool
+text_cached (struct file *file, off_t ofs, size_t read_bytes) {
+	struct text_frame key;
+	bool cached;
+
+	key.inode = file_get_inode (file);
+	key.ofs = ofs;
+	key.read_bytes = read_bytes;
+
+	lock_acquire (&text_lock);
+	cached = hash_find (&text_table, &key.elem) != NULL;
+	lock_release (&text_lock);
+	return cached;
+}
+
+/* Maps PAGE, whose aux is AUX, to the shared frame TF. */
+static bool
+text_map (struct page *page, struct lazy_aux *aux, struct text_frame *tf) {
+	if (!pml4_set_page (page->owner->pml4, page->va, tf->kva, false)) {
+		text_put (tf);
+		return false;
+	}
+
+	/* The loader never runs, so its aux goes now. */
+	free (aux);
+	page->operations = &text_ops;
+	page->zero_mapped = false;
+	page->text.shared = tf;
+	return true;
+}
+
+/* Returns true if PAGE is a read-only page of an executable. */
+static bool
+is_text (struct page *page) {
+	ASSERT (VM_TYPE (page->operations->type) == VM_UNINIT);
+
+	return !page->writable && page->uninit.aux != NULL
+		&& VM_TYPE (page->uninit.type) == VM_ANON;
+}
+
+/* Handles the first fault of PAGE by mapping it to a shared frame, if
+ * it is a read-only page of an executable.  Returns false if the
+ * caller should bring PAGE in privately instead. */
+bool
+text_claim (struct page *page) {
+	struct lazy_aux *aux = page->uninit.aux;
+	struct text_frame *tf;
+
+	if (!is_text (page))
+		return false;
+	tf = text_get (aux, NULL);
+	return tf != NULL && text_map (page, aux, tf);
+}
+
+/* Like text_claim(), for a PAGE whose contents the caller has read into
+ * user frame KVA already.  KVA is taken over in any case: it becomes
+ * the shared frame, or is freed if the page is loaded already or PAGE
+ * cannot be mapped. */
+bool
+text_claim_loaded (struct page *page, void *kva) {
+	struct lazy_aux *aux = page->uninit.aux;
+	struct text_frame *tf;
+
+	if (!is_text (page)) {
+		palloc_free_page (kva);
+		return false;
+	}
+	tf = text_get (aux, kva);
+	if (tf == NULL) {
+		palloc_free_page (kva);
+		return false;
+	}
+	return text_map (page, aux, tf);
+}
+
+/* Fills KVA with a private copy of PAGE. */
+static bool
+text_swap_in (struct page *page, void *kva) {
+	memcpy (kva, page->text.shared->kva, PGSIZE);
+	return true;
+}
+
+/* Drops a private copy of PAGE; it can always be copied again. */
+static bool
+text_swap_out (struct page *page) {
+	pml4_clear_page (page->owner->pml4, page->va);
+	return true;
+}
+
+/* Destroys PAGE. */
+static void
+text_destroy (struct page *page) {
+	struct frame *frame = vm_detach_frame (page);
+
+	if (frame != NULL)
+		vm_free_frame (frame);
+	else {
+		/* Keep pml4_destroy() from freeing the shared frame. */
+		pml4_clear_page (page->owner->pml4, page->va);
+	}
+	text_put (page->text.shared);
+}
+
+/* Prints text sharing statistics. */
+void
+text_print_stats (void) {
+	printf ("Text: %zu shared frames, %"PRIu64" pages loaded, "
+			"%"PRIu64" mapped from memory\n",
+			frame_cnt, load_cnt, hit_cnt);
+}
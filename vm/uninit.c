@@ -10,6 +10,8 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
 
 static bool uninit_initialize (struct page *page, void *kva);
 static void uninit_destroy (struct page *page);
@@ -62,9 +64,12 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
+	struct uninit_page *uninit = &page->uninit;
 	/* TODO: Fill this function.
 	 * TODO: If you don't have anything to do, just return. */
-	palloc_free_page(uninit);
-	return;
+	/* The initializer never ran, so its aux was never consumed. */
+	free (uninit->aux);
+	/* Keep pml4_destroy() from freeing the shared zero frame. */
+	if (page->zero_mapped)
+		pml4_clear_page (page->owner->pml4, page->va);
 }
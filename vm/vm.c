@@ -1,9 +1,78 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/kswapd.h"
+#include "threads/malloc.h"
 #include "threads/mmu.h"
+#include "threads/synch.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall-nr.h>
+
+/* Every frame currently holding a user page, in clock order. */
+static struct list frame_table;
+static struct lock frame_lock;
+/* Signaled under frame_lock whenever an eviction finishes. */
+static struct condition evict_done;
+/* Clock hand for victim selection; NULL means "start at the front". */
+static struct list_elem *clock_hand;
+/* Where the next vm_scan_frames() pass resumes; NULL as above. */
+static struct list_elem *scan_hand;
+
+/* A frame of zeros, mapped read-only for reads of untouched anonymous
+ * pages until the first write gives the page a frame of its own. */
+static void *zero_kva;
+
+/* Number of pages in a huge page. */
+#define HPG_PAGE_CNT (HPGSIZE / PGSIZE)
+
+/* Object caches for struct page and struct frame. */
+static struct slab_cache page_slab;
+static struct slab_cache frame_slab;
+
+/* Working sets.
+
+   Each process counts its page faults, and the clock stamps every
+   frame it finds referenced with its owner's fault count.  A frame is
+   in its owner's working set if it was referenced within the owner's
+   last WS_WINDOW faults.  Measuring age in the owner's own faults
+   rather than in global time means that a process faulting heavily
+   ages only its own pages: the frames of a quiet process stay in its
+   working set however fast a memory hog sweeps the clock around. */
+#define WS_WINDOW 64
+
+/* Resident set accounting of the last processes to exit, for
+ * vm_print_stats(). */
+#define RSS_LOG_CNT 8
+struct rss_record {
+	char name[16];
+	size_t peak_rss;
+	uint64_t fault_cnt;
+	uint64_t ref_cnt;
+};
+static struct rss_record rss_log[RSS_LOG_CNT];
+static size_t rss_log_cnt;
+static struct lock rss_log_lock;
+
+/* Pages locked in memory by mlock(), and the most that may be, so that
+ * eviction always has frames to choose from.  Under frame_lock. */
+static size_t locked_cnt;
+static size_t locked_max;
+
+/* Pages read in by a fault in a file-backed area, by its advice. */
+#define FAULT_AROUND_PAGES 4
+#define FAULT_AROUND_SEQUENTIAL 16
+
+/* Statistics. */
+static uint64_t evict_cnt;          /* Frames evicted. */
+static uint64_t evict_ws_cnt;       /* ...from their owner's working set. */
+static uint64_t direct_cnt;         /* ...by a fault that found no frame. */
+static uint64_t prefetch_cnt;       /* Pages read in by vm_prefetch(). */
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -11,12 +80,25 @@ void
 vm_init (void) {
 	vm_anon_init ();
 	vm_file_init ();
+	vm_text_init ();
 #ifdef EFILESYS  /* For project 4 */
 	pagecache_init ();
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	lock_init (&frame_lock);
+	cond_init (&evict_done);
+	lock_init (&rss_log_lock);
+	clock_hand = NULL;
+	scan_hand = NULL;
+	slab_cache_init (&page_slab, "page", sizeof (struct page), NULL);
+	slab_cache_init (&frame_slab, "frame", sizeof (struct frame), NULL);
+	zero_kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	locked_max = palloc_free_cnt (PAL_USER) / 2;
+	ksm_init ();
+	kswapd_init ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -37,6 +119,8 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static bool vm_claim_huge (struct page *page);
+static bool vm_claim (struct page *page);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -48,24 +132,34 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
+	/* Every page lives inside the area that describes it. */
+	struct vm_area *vma = vma_find (spt, upage);
+	if (vma == NULL)
+		goto err;
+
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
 		/* TODO: Create the page, fetch the initialier according to the VM type,
 		 * TODO: and then create "uninit" page struct by calling uninit_new. You
 		 * TODO: should modify the field after calling the uninit_new. */
-		struct page* new_page = malloc(sizeof(struct page));
+		struct page *new_page = slab_alloc (&page_slab);
+		if (new_page == NULL)
+			goto err;
+
+		if (VM_TYPE(type) == VM_ANON)
+			uninit_new (new_page, upage, init, type, aux, anon_initializer);
+		else
+			uninit_new (new_page, upage, init, type, aux,
+					file_backed_initializer);
+		new_page->writable = writable;
+		new_page->owner = thread_current ();
 
-		if (VM_TYPE(type) == VM_ANON){
-			uninit_new(new_page, upage, init, type, aux, anon_initializer);
-		}
-		else {
-			uninit_new(new_page, upage, init, type, aux, file_backed_initializer);
-		}
-		
 		/* TODO: Insert the page into the spt. */
-		if (spt_insert_page(spt, new_page)){
+		if (spt_insert_page (spt, new_page)) {
+			list_push_back (&vma->pages, &new_page->vma_elem);
 			return true;
-		};
+		}
+		slab_free (&page_slab, new_page);
 	}
 err:
 	return false;
@@ -73,78 +167,279 @@ err:
 
 /* Returns the page containing the given virtual address, or a null pointer if no such page exists. */
 struct page *
-page_lookup (struct hash *h UNUSED, const void *address) {
-  struct page p;
-  struct hash_elem *e;
+page_lookup (struct hash *h, const void *address) {
+	struct page p;
+	struct hash_elem *e;
 
-  p.va = address;
-  e = hash_find (h, &p.hash_elem);
-  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+	p.va = (void *) address;
+	e = hash_find (h, &p.hash_elem);
+	return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
 }
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
-	page = page_lookup(&spt->hash_table, va);
-
-	return page;
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	return page_lookup (&spt->hash_table, pg_round_down (va));
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-	if (hash_insert (&spt->hash_table, &page->hash_elem) == NULL){
-		succ = true;
-	}
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	return hash_insert (&spt->hash_table, &page->hash_elem) == NULL;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->hash_table, &page->hash_elem);
+	list_remove (&page->vma_elem);
+	if (page->locked)
+		vm_unlock_page (page);
 	vm_dealloc_page (page);
+}
+
+/* Adds FRAME, which holds a page, to the frame table and charges it
+ * to the page's owner.  Must be called with frame_lock held. */
+static void
+frame_table_push (struct frame *frame) {
+	struct supplemental_page_table *spt = &frame->page->owner->spt;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame->ref_stamp = spt->fault_cnt;
+	if (++spt->rss > spt->peak_rss)
+		spt->peak_rss = spt->rss;
+	list_push_back (&frame_table, &frame->frame_elem);
+}
+
+/* Like frame_table_push(), but takes frame_lock itself. */
+static void
+frame_table_insert (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame_table_push (frame);
+	lock_release (&frame_lock);
+}
+
+/* Removes FRAME from the frame table, keeping the hands valid.
+ * Must be called with frame_lock held. */
+static void
+frame_table_remove (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (clock_hand == &frame->frame_elem)
+		clock_hand = list_next (clock_hand);
+	if (scan_hand == &frame->frame_elem)
+		scan_hand = list_next (scan_hand);
+	list_remove (&frame->frame_elem);
+	if (frame->page != NULL)
+		frame->page->owner->spt.rss--;
+}
+
+/* Returns true if FRAME may be evicted: its page is neither locked by
+ * mlock() nor pinned for I/O. */
+static bool
+frame_evictable (struct frame *frame) {
+	if (frame->pin_cnt > 0 || frame->page->locked)
+		return false;
+#ifdef EFILESYS
+	if (VM_TYPE (frame->page->operations->type) == VM_PAGE_CACHE)
+		return page_cache_evictable (frame->page);
+#endif
+	return true;
+}
+
+/* Returns true if PAGE was accessed since the clock last asked, and
+ * clears its accessed bit.  Must be called with frame_lock held. */
+static bool
+page_referenced (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+
+#ifdef EFILESYS
+	/* A page cache page is accessed through read(), write() and the
+	 * page tables of the processes mapping it. */
+	if (VM_TYPE (page->operations->type) == VM_PAGE_CACHE)
+		return page_cache_referenced (page);
+#endif
+	if (!pml4_is_accessed (pml4, page->va))
+		return false;
+	pml4_set_accessed (pml4, page->va, false);
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Returns the frame that holds PAGE's contents: its own, or, for a
+ * page mapping the page cache, the cache's.  Must be called with
+ * frame_lock held. */
+static struct frame *
+page_frame (struct page *page) {
+#ifdef EFILESYS
+	if (VM_TYPE (page->operations->type) == VM_FILE
+			&& page->file.cache != NULL)
+		return page->file.cache->frame;
+#endif
+	return page->frame;
+}
+
+/* Waits until the frame that holds PAGE's contents, if any, is not
+ * being evicted, and returns it.  Must be called with frame_lock
+ * held, which is released while waiting. */
+static struct frame *
+settled_frame (struct page *page) {
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	while ((frame = page_frame (page)) != NULL && frame->evicting)
+		cond_wait (&evict_done, &frame_lock);
+	return frame;
+}
+
+/* Returns true if FRAME is in its owner's working set. */
+static bool
+frame_in_working_set (struct frame *frame) {
+	struct supplemental_page_table *spt = &frame->page->owner->spt;
+	return spt->fault_cnt - frame->ref_stamp < WS_WINDOW;
+}
+
+/* Get the struct frame, that will be evicted.
+ * Second-chance clock over the frame table: a frame whose page was
+ * accessed since the hand last passed gets its bit cleared, is stamped
+ * as referenced, and is skipped once.  During the first revolution
+ * frames in their owner's working set are skipped as well, so that
+ * memory is taken from processes holding more than their working set
+ * before anyone else.  Frames that are not evictable are never chosen.
+ * Returns NULL if no frame is.  Must be called with
+ * frame_lock held. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (list_empty (&frame_table))
+		return NULL;
+
+	size_t frame_cnt = list_size (&frame_table);
+	for (size_t i = 0; i < 3 * frame_cnt + 1; i++) {
+		if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+
+		struct frame *frame = list_entry (clock_hand, struct frame, frame_elem);
+		struct page *page = frame->page;
+		struct supplemental_page_table *spt = &page->owner->spt;
+		clock_hand = list_next (clock_hand);
+		if (!frame_evictable (frame))
+			continue;
+
+		if (page_referenced (page)) {
+			frame->ref_stamp = spt->fault_cnt;
+			spt->ref_cnt++;
+		} else if (i >= frame_cnt || !frame_in_working_set (frame))
+			return frame;
+	}
+	/* Every frame was referenced twice in a row; take the first
+	 * evictable one from the hand. */
+	for (size_t i = 0; i < frame_cnt; i++) {
+		if (clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+
+		struct frame *frame = list_entry (clock_hand, struct frame, frame_elem);
+		if (frame_evictable (frame))
+			return frame;
+		clock_hand = list_next (clock_hand);
+	}
+	return NULL;
+}
+
+/* Takes VICTIM, a frame chosen for eviction, out of the frame table
+ * and marks it as being evicted, so that its page can be written out
+ * without frame_lock.  Until evict_end(), whoever finds the frame
+ * through its page waits in settled_frame().  Must be called with
+ * frame_lock held. */
+static void
+evict_begin (struct frame *victim) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame_in_working_set (victim))
+		evict_ws_cnt++;
+	frame_table_remove (victim);
+	victim->evicting = true;
+}
 
-	return victim;
+/* Finishes the eviction of VICTIM: detaches it from its page if the
+ * page was WRITTEN out, or, if it could not be, puts it back in the
+ * frame table.  Must be called with frame_lock held. */
+static void
+evict_end (struct frame *victim, bool written) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (victim->evicting);
+
+	victim->evicting = false;
+	if (written) {
+		victim->page->frame = NULL;
+		victim->page = NULL;
+		evict_cnt++;
+	} else {
+		/* Out of swap: leave it resident. */
+		frame_table_push (victim);
+	}
+	cond_broadcast (&evict_done, &frame_lock);
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.  Must be called with frame_lock held, which
+ * is released while the page is written out. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
+	struct frame *victim = vm_get_victim ();
+	bool written;
+
+	if (victim == NULL)
+		return NULL;
+
 	/* TODO: swap out the victim and return the evicted frame. */
+	evict_begin (victim);
+	lock_release (&frame_lock);
+	written = swap_out (victim->page);
+	lock_acquire (&frame_lock);
+	evict_end (victim, written);
+	return written ? victim : NULL;
+}
 
-	return NULL;
+/* Returns the cache colour wanted for PAGE: consecutive colours for
+ * consecutive pages, starting from a different colour in each process
+ * so that processes running the same program do not collide. */
+static size_t
+page_color (struct page *page) {
+	return pg_no (page->va) + page->owner->tid;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.  A free frame is taken of the cache colour of PAGE, so that
+ * consecutive pages of a process land in different cache sets. */
 static struct frame *
-vm_get_frame (void) {
+vm_get_frame (struct page *page) {
 	struct frame *frame = NULL;
 	/* TODO: Fill this function. */
-	void *kpage = palloc_get_page(PAL_USER);
-	if (kpage){
-		frame = malloc(sizeof(struct frame));
+	void *kpage = palloc_get_page_colored (PAL_USER, page_color (page));
+	kswapd_poke ();
+	if (kpage != NULL) {
+		frame = slab_alloc (&frame_slab);
+		if (frame == NULL) {
+			palloc_free_page (kpage);
+			PANIC ("out of kernel memory for frame table");
+		}
 		frame->kva = kpage;
 		frame->page = NULL;
-	}
-	else{
-		PANIC ("todo");
+		frame->pin_cnt = 0;
+		frame->evicting = false;
+	} else {
+		/* kswapd fell behind; evict one page ourselves. */
+		lock_acquire (&frame_lock);
+		frame = vm_evict_frame ();
+		if (frame != NULL)
+			direct_cnt++;
+		lock_release (&frame_lock);
+		if (frame == NULL)
+			PANIC ("no frame could be evicted");
 	}
 
 	ASSERT (frame != NULL);
@@ -152,79 +447,747 @@ vm_get_frame (void) {
 	return frame;
 }
 
+/* Takes PAGE's frame out of the frame table so that it can no longer be
+ * chosen for eviction, and returns it.  Returns NULL if PAGE is not
+ * resident, which includes the case where an eviction racing with the
+ * caller already wrote it out.  The mapping is left in place so the
+ * caller can still inspect its dirty bit. */
+struct frame *
+vm_detach_frame (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	settled_frame (page);
+	frame = page->frame;
+	if (frame != NULL)
+		frame_table_remove (frame);
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Unmaps a frame obtained from vm_detach_frame() and returns its memory
+ * to the user pool. */
+void
+vm_free_frame (struct frame *frame) {
+	struct page *page = frame->page;
+
+	if (page != NULL) {
+		pml4_clear_page (page->owner->pml4, page->va);
+		page->frame = NULL;
+	}
+	palloc_free_page (frame->kva);
+	slab_free (&frame_slab, frame);
+}
+
+/* Brings in PAGE, a page of a kernel thread that is not mapped in
+ * any page table, and returns its contents with the frame pinned, as
+ * by vm_pin_frame().  Returns NULL if PAGE cannot be read in. */
+void *
+vm_claim_frame (struct page *page) {
+	struct frame *frame = vm_get_frame (page);
+
+	frame->page = page;
+	frame->pin_cnt = 1;
+	page->frame = frame;
+	if (!swap_in (page, frame->kva)) {
+		page->frame = NULL;
+		palloc_free_page (frame->kva);
+		slab_free (&frame_slab, frame);
+		return NULL;
+	}
+	frame_table_insert (frame);
+	return frame->kva;
+}
+
+/* Pins the frame of PAGE, if it is resident, so that it cannot be
+ * evicted, and returns its contents.  Returns NULL if PAGE is not
+ * resident. */
+void *
+vm_pin_frame (struct page *page) {
+	void *kva = NULL;
+
+	lock_acquire (&frame_lock);
+	settled_frame (page);
+	if (page->frame != NULL) {
+		page->frame->pin_cnt++;
+		kva = page->frame->kva;
+	}
+	lock_release (&frame_lock);
+	return kva;
+}
+
+/* Drops a pin taken by vm_pin_frame() or vm_claim_frame(). */
+void
+vm_unpin_frame (struct page *page) {
+	lock_acquire (&frame_lock);
+	ASSERT (page->frame != NULL && page->frame->pin_cnt > 0);
+	page->frame->pin_cnt--;
+	lock_release (&frame_lock);
+}
+
+/* Calls VISIT on up to CNT frames of the frame table, resuming where
+ * the previous scan stopped, with the table locked throughout.  While
+ * the lock is held no frame leaves the table except through VISIT, and
+ * a write to a write-protected page waits in vm_handle_wp(). */
+void
+vm_scan_frames (size_t cnt, vm_frame_visitor *visit, void *aux) {
+	lock_acquire (&frame_lock);
+	if (cnt > list_size (&frame_table))
+		cnt = list_size (&frame_table);
+	while (cnt-- > 0) {
+		if (scan_hand == NULL || scan_hand == list_end (&frame_table))
+			scan_hand = list_begin (&frame_table);
+
+		struct frame *frame = list_entry (scan_hand, struct frame, frame_elem);
+		scan_hand = list_next (scan_hand);
+		visit (frame, aux);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Removes FRAME from the frame table and from its page, frees it, and
+ * returns its memory, which now belongs to the caller.  The page's
+ * mapping is left alone.  Only for use by a vm_scan_frames() visitor. */
+void *
+vm_steal_frame (struct frame *frame) {
+	void *kva = frame->kva;
+
+	frame_table_remove (frame);
+	if (frame->page != NULL)
+		frame->page->frame = NULL;
+	slab_free (&frame_slab, frame);
+	return kva;
+}
+
+/* Returns the inode that backs P, a page that is not anonymous, and
+ * stores P's offset in it into *OFS. */
+static struct inode *
+page_backing (const struct page *p, off_t *ofs) {
+	switch (VM_TYPE (p->operations->type)) {
+		case VM_FILE:
+			*ofs = p->file.ofs;
+			return file_get_inode (p->file.file);
+		case VM_TEXT:
+			*ofs = p->text.shared->ofs;
+			return p->text.shared->inode;
+#ifdef EFILESYS
+		case VM_PAGE_CACHE:
+			*ofs = p->page_cache.ofs;
+			return p->page_cache.inode;
+#endif
+		default:
+			NOT_REACHED ();
+	}
+}
+
+/* Orders frames for write-out in vm_reclaim(): anonymous pages first,
+ * by owner and address, then file pages by file and offset. */
+static int
+reclaim_order (const void *a_, const void *b_) {
+	const struct page *a = (*(struct frame *const *) a_)->page;
+	const struct page *b = (*(struct frame *const *) b_)->page;
+	int a_anon = VM_TYPE (a->operations->type) == VM_ANON;
+	int b_anon = VM_TYPE (b->operations->type) == VM_ANON;
+	struct inode *a_inode, *b_inode;
+	off_t a_ofs, b_ofs;
+
+	if (a_anon != b_anon)
+		return b_anon - a_anon;
+	if (a_anon) {
+		if (a->owner != b->owner)
+			return a->owner < b->owner ? -1 : 1;
+		return a->va < b->va ? -1 : a->va > b->va;
+	}
+	a_inode = page_backing (a, &a_ofs);
+	b_inode = page_backing (b, &b_ofs);
+	if (a_inode != b_inode)
+		return a_inode < b_inode ? -1 : 1;
+	return a_ofs < b_ofs ? -1 : a_ofs > b_ofs;
+}
+
+/* Evicts up to CNT frames, at most VM_RECLAIM_MAX, as one batch and
+ * gives their memory back to the user pool.  The anonymous pages of the
+ * batch are written to a run of consecutive swap slots, and the file
+ * pages in file order, so that the writes are clustered.  The victims
+ * are chosen under frame_lock, but written out without it, so that
+ * faults and allocations elsewhere go on during the I/O.  Returns the
+ * number of frames freed. */
+size_t
+vm_reclaim (size_t cnt) {
+	struct frame *batch[VM_RECLAIM_MAX];
+	bool written[VM_RECLAIM_MAX];
+	size_t batch_cnt = 0, anon_cnt = 0, freed = 0, slot, i;
+
+	if (cnt > VM_RECLAIM_MAX)
+		cnt = VM_RECLAIM_MAX;
+
+	lock_acquire (&frame_lock);
+	while (batch_cnt < cnt) {
+		struct frame *victim = vm_get_victim ();
+		if (victim == NULL)
+			break;
+		evict_begin (victim);
+		batch[batch_cnt++] = victim;
+		if (VM_TYPE (victim->page->operations->type) == VM_ANON)
+			anon_cnt++;
+	}
+	lock_release (&frame_lock);
+	qsort (batch, batch_cnt, sizeof *batch, reclaim_order);
+
+	slot = anon_cnt > 0 ? anon_reserve_slots (anon_cnt) : SWAP_SLOT_NONE;
+	for (i = 0; i < batch_cnt; i++) {
+		struct page *page = batch[i]->page;
+
+		if (slot != SWAP_SLOT_NONE
+				&& VM_TYPE (page->operations->type) == VM_ANON)
+			page->anon.swap_slot = slot++;
+		written[i] = swap_out (page);
+	}
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < batch_cnt; i++) {
+		evict_end (batch[i], written[i]);
+		if (written[i])
+			batch[freed++] = batch[i];
+	}
+	lock_release (&frame_lock);
+
+	for (i = 0; i < freed; i++) {
+		palloc_free_page (batch[i]->kva);
+		slab_free (&frame_slab, batch[i]);
+	}
+	return freed;
+}
+
 /* Growing the stack. */
 static void
 vm_stack_growth (void *addr UNUSED) {
 }
 
+/* Returns true if PAGE has never been touched and has no contents
+ * other than zeros, so that reading it may be served by the zero
+ * frame. */
+static bool
+vm_is_zero_page (struct page *page) {
+	return page->operations->type == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Maps PAGE read-only to the shared zero frame. */
+static bool
+vm_map_zero_page (struct page *page) {
+	if (!pml4_set_page (page->owner->pml4, page->va, zero_kva, false))
+		return false;
+	page->zero_mapped = true;
+	return true;
+}
+
+/* Tries to bring in the whole 2 MB block around PAGE at once, backed
+ * by physically contiguous frames and mapped by a single page directory
+ * entry.  Every 4 kB page of the block keeps its own struct page and
+ * struct frame, so eviction, fork and ksmd handle them as usual; the
+ * first change to one of them in the page table splits the mapping.
+ *
+ * The block must lie in a writable anonymous area and none of its
+ * pages may have been touched.  Returns true if PAGE is now resident,
+ * false if the caller should fall back to claiming PAGE alone. */
+static bool
+vm_claim_huge (struct page *page) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *base = hpg_round_down (page->va);
+	struct vm_area *vma = vma_find (spt, page->va);
+	uint8_t *kva;
+	size_t i, filled;
+
+	if (vma == NULL || VM_TYPE (vma->type) != VM_ANON || !vma->writable
+			|| (void *) base < vma->start
+			|| (void *) (base + HPGSIZE) > vma->end)
+		return false;
+	for (i = 0; i < HPG_PAGE_CNT; i++) {
+		struct page *p = spt_find_page (spt, base + i * PGSIZE);
+		if (p != NULL && (VM_TYPE (p->operations->type) != VM_UNINIT
+					|| p->zero_mapped))
+			return false;
+	}
+
+	kva = palloc_get_multiple_aligned (PAL_USER, HPG_PAGE_CNT, HPG_PAGE_CNT);
+	if (kva == NULL)
+		return false;
+
+	/* Give every page of the block its frame in the run. */
+	for (i = 0; i < HPG_PAGE_CNT; i++) {
+		struct page *p = spt_find_page (spt, base + i * PGSIZE);
+		struct frame *frame;
+
+		if (p == NULL)
+			p = vma_populate (vma, base + i * PGSIZE);
+		frame = p != NULL ? slab_alloc (&frame_slab) : NULL;
+		if (frame == NULL) {
+			while (i-- > 0) {
+				p = spt_find_page (spt, base + i * PGSIZE);
+				slab_free (&frame_slab, p->frame);
+				p->frame = NULL;
+			}
+			palloc_free_multiple (kva, HPG_PAGE_CNT);
+			return false;
+		}
+		frame->kva = kva + i * PGSIZE;
+		frame->page = p;
+		frame->pin_cnt = 0;
+		frame->evicting = false;
+		p->frame = frame;
+	}
+
+	/* Fill them in, then map the block. */
+	for (filled = 0; filled < HPG_PAGE_CNT; filled++) {
+		struct page *p = spt_find_page (spt, base + filled * PGSIZE);
+		if (!swap_in (p, p->frame->kva))
+			break;
+	}
+	if (filled < HPG_PAGE_CNT
+			|| !pml4_set_huge_page (page->owner->pml4, base, kva, true)) {
+		/* Keep what was filled in as ordinary pages. */
+		for (i = 0; i < HPG_PAGE_CNT; i++) {
+			struct page *p = spt_find_page (spt, base + i * PGSIZE);
+			struct frame *frame = p->frame;
+
+			if (i < filled && pml4_set_page (p->owner->pml4, p->va,
+						frame->kva, true))
+				continue;
+			p->frame = NULL;
+			palloc_free_page (frame->kva);
+			slab_free (&frame_slab, frame);
+		}
+	}
+
+	for (i = 0; i < HPG_PAGE_CNT; i++) {
+		struct page *p = spt_find_page (spt, base + i * PGSIZE);
+		if (p->frame != NULL)
+			frame_table_insert (p->frame);
+	}
+	return page->frame != NULL;
+}
+
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	if (!page->writable)
+		return false;
+
+	lock_acquire (&frame_lock);
+	if (settled_frame (page) != NULL) {
+		/* Still private; ksmd only write-protected it to compare it. */
+		bool ok = pml4_set_page (page->owner->pml4, page->va,
+				page->frame->kva, true);
+		lock_release (&frame_lock);
+		return ok;
+	}
+	lock_release (&frame_lock);
+
+	/* First write to a page that shares the zero frame or a merged
+	 * frame: copy it into a private frame of its own. */
+	pml4_clear_page (page->owner->pml4, page->va);
+	page->zero_mapped = false;
+	return vm_do_claim_page (page);
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
+		bool user UNUSED, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 	struct page *page = NULL;
+
 	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
-	// printf("addr: %p\n",addr);
+	if (addr == NULL || is_kernel_vaddr (addr))
+		return false;
+	spt->fault_cnt++;
 
-	page = spt_find_page(spt, pg_round_down(addr));
-	if (page == NULL) return false; 
+	page = spt_find_page (spt, addr);
+	if (page == NULL) {
+		/* First touch of this page: create it from its area. */
+		struct vm_area *vma = vma_find (spt, addr);
+		if (vma == NULL || (write && !vma->writable))
+			return false;
+		page = vma_populate (vma, pg_round_down (addr));
+		if (page == NULL)
+			return false;
+	}
+	if (!not_present)
+		return vm_handle_wp (page);
+	if (write && !page->writable)
+		return false;
+	if (!write && vm_is_zero_page (page))
+		return vm_map_zero_page (page);
+	if (page->frame != NULL) {
+		/* Another thread is evicting this page.  Once it is done, the
+		 * page is ours to bring back, unless it stayed resident. */
+		bool resident;
 
-	return vm_do_claim_page (page);
+		lock_acquire (&frame_lock);
+		resident = settled_frame (page) != NULL;
+		lock_release (&frame_lock);
+		if (resident)
+			return true;
+	}
+	return vm_claim (page);
 }
 
-/* Free the page.
- * DO NOT MODIFY THIS FUNCTION. */
+/* Free the page.  Pages come from page_slab, not malloc(), so this
+ * function returns them there. */
 void
 vm_dealloc_page (struct page *page) {
 	destroy (page);
-	free (page);
+	slab_free (&page_slab, page);
 }
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
-	// page = malloc(sizeof(struct page));
-	// page->va = va;
-	page = spt_find_page(&thread_current()->spt, va);
+vm_claim_page (void *va) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page = spt_find_page (spt, va);
+
+	if (page == NULL) {
+		struct vm_area *vma = vma_find (spt, va);
+		if (vma == NULL)
+			return false;
+		page = vma_populate (vma, pg_round_down (va));
+		if (page == NULL)
+			return false;
+	}
+
+	return vm_do_claim_page (page);
+}
+
+/* Initializer of a page whose contents vm_prefetch() has read in
+ * already; only its aux is left to free. */
+static bool
+prefetched_init (struct page *page UNUSED, void *aux) {
+	free (aux);
+	return true;
+}
+
+/* Brings in up to CNT pages of the file-backed area at VA ahead of
+ * their first faults, with one read of the file into a run of
+ * contiguous frames, instead of one read per fault.  The run ends at
+ * the first page that is past the file data, touched already, or, in a
+ * read-only executable segment, loaded by another process already.
+ * Read-only executable pages go to the shared text frames, the others
+ * get private frames.
+ *
+ * Prefetching is opportunistic: it takes at most half of the free user
+ * frames and never evicts, and pages it leaves out are still loaded on
+ * their first fault.  Returns the number of pages brought in. */
+size_t
+vm_prefetch (void *va, size_t cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_area *vma = vma_find (spt, va);
+	size_t page_ofs, read_bytes, free_cnt, n, i;
+	size_t used = 0;                /* Frames of KVA handed out. */
+	uint8_t *kva;
+	bool text;
+
+	ASSERT (pg_ofs (va) == 0);
+
+	if (vma == NULL || vma->file == NULL)
+		return 0;
+#ifdef EFILESYS
+	/* File mappings share the page cache's frames instead. */
+	if (VM_TYPE (vma->type) == VM_FILE)
+		return 0;
+#endif
+	text = VM_TYPE (vma->type) == VM_ANON && !vma->writable;
+	page_ofs = (uint8_t *) va - (uint8_t *) vma->start;
+
+	for (n = 0; n < cnt; n++) {
+		uint8_t *upage = (uint8_t *) va + n * PGSIZE;
+		size_t ofs = page_ofs + n * PGSIZE;
+		struct page *p;
+
+		if ((void *) upage >= vma->end || ofs >= vma->read_bytes)
+			break;
+		p = spt_find_page (spt, upage);
+		if (p != NULL && (VM_TYPE (p->operations->type) != VM_UNINIT
+					|| p->zero_mapped))
+			break;
+		if (text && text_cached (vma->file, vma->ofs + ofs,
+					vma->read_bytes - ofs < PGSIZE
+					? vma->read_bytes - ofs : PGSIZE))
+			break;
+	}
+	free_cnt = palloc_free_cnt (PAL_USER);
+	if (n > free_cnt / 2)
+		n = free_cnt / 2;
+	if (n == 0)
+		return 0;
+
+	while ((kva = palloc_get_multiple (PAL_USER, n)) == NULL)
+		if ((n /= 2) == 0)
+			return 0;
+
+	read_bytes = vma->read_bytes - page_ofs;
+	if (read_bytes > n * PGSIZE)
+		read_bytes = n * PGSIZE;
+	if (file_read_at (vma->file, kva, read_bytes, vma->ofs + page_ofs)
+			!= (off_t) read_bytes) {
+		palloc_free_multiple (kva, n);
+		return 0;
+	}
+	memset (kva + read_bytes, 0, n * PGSIZE - read_bytes);
+
+	for (i = 0; i < n; i++) {
+		uint8_t *upage = (uint8_t *) va + i * PGSIZE;
+		struct page *p = spt_find_page (spt, upage);
+		struct frame *frame;
+
+		if (p == NULL)
+			p = vma_populate (vma, upage);
+		if (p == NULL)
+			break;
+		if (text) {
+			/* The frame is taken over even if this fails. */
+			used = i + 1;
+			if (!text_claim_loaded (p, kva + i * PGSIZE))
+				break;
+			continue;
+		}
+
+		frame = slab_alloc (&frame_slab);
+		if (frame == NULL)
+			break;
+		frame->kva = kva + i * PGSIZE;
+		frame->page = p;
+		frame->pin_cnt = 0;
+		frame->evicting = false;
+		p->frame = frame;
+		if (!pml4_set_page (p->owner->pml4, p->va, frame->kva,
+					vma->writable)) {
+			p->frame = NULL;
+			slab_free (&frame_slab, frame);
+			break;
+		}
+		/* The contents are in place, so initializing cannot fail. */
+		p->uninit.init = prefetched_init;
+		swap_in (p, frame->kva);
+		frame_table_insert (frame);
+		used = i + 1;
+	}
 
+	/* Give back the frames of the pages left out. */
+	if (used < n)
+		palloc_free_multiple (kva + used * PGSIZE, n - used);
+	prefetch_cnt += i;
+	return i;
+}
+
+/* Reads pages in around PAGE, which is being faulted in, if it lies in
+ * a file-backed area: a few pages normally, more for an area advised
+ * MADV_SEQUENTIAL, and none for MADV_RANDOM.  Returns true if PAGE
+ * was brought in. */
+static bool
+fault_around (struct page *page) {
+	struct vm_area *vma = vma_find (&page->owner->spt, page->va);
+
+	if (vma == NULL || vma->file == NULL || vma->advice == MADV_RANDOM)
+		return false;
+	return vm_prefetch (page->va, vma->advice == MADV_SEQUENTIAL
+			? FAULT_AROUND_SEQUENTIAL : FAULT_AROUND_PAGES) > 0;
+}
+
+/* Brings in PAGE, which is not resident.  A page that was never loaded
+ * may become part of a huge page, come in with its neighbours, or be
+ * mapped to a shared text frame; file data of a file mapping is mapped
+ * from the page cache; anything else gets a frame of its own. */
+static bool
+vm_claim (struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& (vm_claim_huge (page) || fault_around (page)
+				|| text_claim (page)))
+		return true;
+#ifdef EFILESYS
+	if (page_get_type (page) == VM_FILE && file_backed_cached (page))
+		return file_backed_map (page);
+#endif
 	return vm_do_claim_page (page);
 }
 
+/* Evicts PAGE right away if it is resident in a frame of the frame
+ * table that may be evicted, and gives the frame back to the user
+ * pool. */
+void
+vm_page_out (struct page *page) {
+	struct frame *frame;
+
+	bool written;
+
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame == NULL || frame->evicting || !frame_evictable (frame)) {
+		lock_release (&frame_lock);
+		return;
+	}
+	evict_begin (frame);
+	lock_release (&frame_lock);
+	written = swap_out (page);
+	lock_acquire (&frame_lock);
+	evict_end (frame, written);
+	lock_release (&frame_lock);
+
+	if (written) {
+		palloc_free_page (frame->kva);
+		slab_free (&frame_slab, frame);
+	}
+}
+
+/* Locks PAGE of the current process in memory: brings it in if it is
+ * not resident, and keeps the clock from evicting it until
+ * vm_unlock_page().  Returns false if too many pages are locked
+ * already or PAGE cannot be brought in. */
+bool
+vm_lock_page (struct page *page) {
+	lock_acquire (&frame_lock);
+	if (!page->locked) {
+		if (locked_cnt >= locked_max) {
+			lock_release (&frame_lock);
+			return false;
+		}
+		page->locked = true;
+		locked_cnt++;
+	}
+	/* No eviction starts on a locked page; wait for one that started
+	 * already.  Then a page that is mapped now stays so. */
+	settled_frame (page);
+	lock_release (&frame_lock);
+
+	if (pml4_get_page (page->owner->pml4, page->va) != NULL
+			|| vm_claim (page))
+		return true;
+	vm_unlock_page (page);
+	return false;
+}
+
+/* Lets PAGE be evicted again. */
+void
+vm_unlock_page (struct page *page) {
+	lock_acquire (&frame_lock);
+	if (page->locked) {
+		page->locked = false;
+		locked_cnt--;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Makes page VA of the current process ready for the kernel to read,
+ * or to write if WRITE is true, and pins its frame, if it has one of
+ * its own or maps the page cache's, so that it stays put.  Other frames
+ * shared with other pages are never evicted and need no pin.  Returns
+ * false if VA is not valid for the access. */
+static bool
+pin_page (void *va, bool write) {
+	struct thread *t = thread_current ();
+
+	for (;;) {
+		struct page *page = spt_find_page (&t->spt, va);
+		struct frame *frame;
+		bool present;
+
+		/* The kernel must not write where the user may not, even if
+		 * the page is resident: with CR0.WP set, that faults. */
+		if (page != NULL && write && !page->writable)
+			return false;
+
+		lock_acquire (&frame_lock);
+		frame = page != NULL ? settled_frame (page) : NULL;
+		present = pml4_get_page (t->pml4, va) != NULL;
+		if (page != NULL && present && (frame != NULL || !write)) {
+			if (frame != NULL)
+				frame->pin_cnt++;
+			lock_release (&frame_lock);
+			return true;
+		}
+		lock_release (&frame_lock);
+
+		/* Take the fault the kernel would have taken. */
+		if (!vm_try_handle_fault (NULL, va, false, write, !present))
+			return false;
+	}
+}
+
+/* Brings in every page of the SIZE bytes of user memory at BUFFER and
+ * pins them, so that the kernel can read them, or write them if WRITE
+ * is true, without faulting and without the pages being evicted under
+ * it.  Returns false, with nothing pinned, if BUFFER is not valid user
+ * memory for the access.  The pins are dropped with vm_unpin_buffer(). */
+bool
+vm_pin_buffer (const void *buffer, size_t size, bool write) {
+	uint8_t *start = pg_round_down (buffer);
+	uint8_t *end = (uint8_t *) buffer + size;
+	uint8_t *va;
+
+	if (size == 0)
+		return true;
+	if (buffer == NULL || end < (uint8_t *) buffer || !is_user_vaddr (end - 1))
+		return false;
+
+	for (va = start; va < end; va += PGSIZE)
+		if (!pin_page (va, write)) {
+			vm_unpin_buffer (start, va - start);
+			return false;
+		}
+	return true;
+}
+
+/* Drops the pins vm_pin_buffer() took on the SIZE bytes at BUFFER. */
+void
+vm_unpin_buffer (const void *buffer, size_t size) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) buffer + size;
+	uint8_t *va;
+
+	lock_acquire (&frame_lock);
+	for (va = pg_round_down (buffer); va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+		struct frame *frame = page != NULL ? page_frame (page) : NULL;
+
+		if (frame != NULL && frame->pin_cnt > 0)
+			frame->pin_cnt--;
+	}
+	lock_release (&frame_lock);
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame = vm_get_frame (page);
 
 	/* Set links */
 	frame->page = page;
 	page->frame = frame;
 
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
-	pml4_set_page(thread_current()->pml4, page->va,frame->kva,true);
-
-	// struct supplemental_page_table *spt = &thread_current()->spt;
-	// spt_insert_page(spt,page);
+	if (!swap_in (page, frame->kva)
+			|| !pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		page->frame = NULL;
+		palloc_free_page (frame->kva);
+		slab_free (&frame_slab, frame);
+		return false;
+	}
 
-	return swap_in (page, frame->kva);
+	frame_table_insert (frame);
+	return true;
 }
 
 /* Returns a hash value for page p. */
-unsigned
+static uint64_t
 page_hash (const struct hash_elem *p_, void *aux UNUSED) {
 	const struct page *p = hash_entry (p_, struct page, hash_elem);
 	return hash_bytes (&p->va, sizeof p->va);
 }
 
 /* Returns true if page a precedes page b. */
-bool
+static bool
 page_less (const struct hash_elem *a_,
            const struct hash_elem *b_, void *aux UNUSED) {
 	const struct page *a = hash_entry (a_, struct page, hash_elem);
@@ -235,56 +1198,158 @@ page_less (const struct hash_elem *a_,
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
-	hash_init(&spt->hash_table, page_hash, page_less, NULL);
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	hash_init (&spt->hash_table, page_hash, page_less, NULL);
+	vma_init (spt);
+	spt->rss = 0;
+	spt->peak_rss = 0;
+	spt->fault_cnt = 0;
+	spt->ref_cnt = 0;
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst.
+ * Runs in the child while the parent sleeps in fork().  The areas are
+ * copied first; pages the parent never faulted stay unmaterialized in
+ * the child too.  File mappings are not inherited. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
-	// struct hash_iterator i;
-	// hash_first (&i, &src->hash_table);
-	// while (hash_next (&i)) {
-	// 	struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
-	// 	if (!spt_insert_page(dst, p)) 
-	// 		return false;
-	// }
-	// return true;
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+
+	if (!vma_copy (dst, src))
+		return false;
+
+	hash_first (&i, &src->hash_table);
+	while (hash_next (&i)) {
+		struct page *src_page = hash_entry (hash_cur (&i), struct page,
+				hash_elem);
+		enum vm_type type = page_get_type (src_page);
+
+		if (VM_TYPE (type) == VM_FILE)
+			continue;
+
+		/* Not yet faulted in the parent, or shared text: the child's
+		 * area covers it. */
+		if (VM_TYPE (src_page->operations->type) == VM_UNINIT
+				|| VM_TYPE (type) == VM_TEXT)
+			continue;
+
+		if (!vm_alloc_page (type, src_page->va, src_page->writable))
+			return false;
+		struct page *dst_page = spt_find_page (&thread_current ()->spt,
+				src_page->va);
+
+		/* Bringing one side in may push the other out again, so copy
+		 * with both frames pinned. */
+		for (;;) {
+			void *src_kva, *dst_kva;
+
+			if (src_page->frame == NULL && !vm_do_claim_page (src_page))
+				return false;
+			if (dst_page->frame == NULL && !vm_do_claim_page (dst_page))
+				return false;
+
+			src_kva = vm_pin_frame (src_page);
+			dst_kva = vm_pin_frame (dst_page);
+			if (src_kva != NULL && dst_kva != NULL)
+				memcpy (dst_kva, src_kva, PGSIZE);
+			if (src_kva != NULL)
+				vm_unpin_frame (src_page);
+			if (dst_kva != NULL)
+				vm_unpin_frame (dst_page);
+			if (src_kva != NULL && dst_kva != NULL)
+				break;
+		}
+	}
+	return true;
+}
+
+/* Destroys one page of the table being killed. */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) {
+	struct page *page = hash_entry (e, struct page, hash_elem);
+	list_remove (&page->vma_elem);
+	if (page->locked)
+		vm_unlock_page (page);
+	vm_dealloc_page (page);
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
-	// struct hash_iterator i;
-	// hash_first (&i, &spt->hash_table);
-	// while (hash_next (&i)) {
-	// 	struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
-	// 	hash_destroy()
-	// 	if (!spt_insert_page(dst, p)) 
-	// 		return false;
-	// }
-	// struct hash *h = &spt->hash_table;
-	// size_t i;
-
-	// for (i = 0; i < h->bucket_cnt; i++) {
-	// 	struct list *bucket = &h->buckets[i];
-
-	// 	while (!list_empty (bucket)) {
-	// 		struct list_elem *list_elem = list_pop_front (bucket);
-	// 		struct hash_elem *hash_elem = list_entry(list_elem, struct hash_elem, list_elem);
-	// 		struct page *page = hash_entry(hash_elem, struct page, hash_elem);
-	// 		(page->operations->destroy)(page);
-			
-	// 		palloc_free_page(page);
-	// 	}
-
-	// 	list_init (bucket);
-	// }
-
-	// h->elem_cnt = 0;
+	/* Only faulted pages exist, so this is proportional to the resident
+	 * set rather than to the size of the address space.  Dirty file
+	 * pages are written back by their destructor while the areas still
+	 * hold the files open. */
+	hash_clear (&spt->hash_table, page_destructor);
+	vma_kill (spt);
+}
 
-	return true;
+/* Records the resident set accounting of SPT, the table of the current
+ * process, which is exiting, for vm_print_stats().  Not called on
+ * exec(), which kills the table too but keeps the process. */
+void
+vm_record_exit (struct supplemental_page_table *spt) {
+	struct rss_record *r;
+
+	if (spt->peak_rss == 0)
+		return;
+
+	lock_acquire (&rss_log_lock);
+	r = &rss_log[rss_log_cnt++ % RSS_LOG_CNT];
+	strlcpy (r->name, thread_name (), sizeof r->name);
+	r->peak_rss = spt->peak_rss;
+	r->fault_cnt = spt->fault_cnt;
+	r->ref_cnt = spt->ref_cnt;
+	lock_release (&rss_log_lock);
+}
+
+/* Returns ITEM, one of the MEMSTAT_* values, of the current process's
+ * resident set accounting, or -1 if ITEM is not valid. */
+int64_t
+vm_memstat (int item) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct list_elem *e;
+	int64_t wss = 0;
+
+	switch (item) {
+		case MEMSTAT_RSS:
+			return spt->rss;
+		case MEMSTAT_FAULTS:
+			return spt->fault_cnt;
+		case MEMSTAT_REFS:
+			return spt->ref_cnt;
+		case MEMSTAT_WSS:
+			lock_acquire (&frame_lock);
+			for (e = list_begin (&frame_table); e != list_end (&frame_table);
+					e = list_next (e)) {
+				struct frame *frame = list_entry (e, struct frame, frame_elem);
+				if (frame->page->owner == thread_current ()
+						&& frame_in_working_set (frame))
+					wss++;
+			}
+			lock_release (&frame_lock);
+			return wss;
+		default:
+			return -1;
+	}
+}
+
+/* Prints eviction statistics and the resident set accounting of the
+ * last processes to exit. */
+void
+vm_print_stats (void) {
+	size_t i = rss_log_cnt > RSS_LOG_CNT ? rss_log_cnt - RSS_LOG_CNT : 0;
+
+	printf ("VM: %"PRIu64" evictions, %"PRIu64" direct, "
+			"%"PRIu64" from a working set, %"PRIu64" pages prefetched\n",
+			evict_cnt, direct_cnt, evict_ws_cnt, prefetch_cnt);
+	for (; i < rss_log_cnt; i++) {
+		struct rss_record *r = &rss_log[i % RSS_LOG_CNT];
+		printf ("VM: %s: peak RSS %zu pages, %"PRIu64" faults, "
+				"%"PRIu64" references\n",
+				r->name, r->peak_rss, r->fault_cnt, r->ref_cnt);
+	}
 }
@@ -0,0 +1,199 @@
+/* vma.c: Per-process tree of virtual memory areas.
+ *
+ * Executable segments, mmap regions and the stack are recorded here as
+ * ranges when they are set up.  The per-page `struct page' entries in
+ * the supplemental page table are created from the owning area on the
+ * first fault of each page. */
+
+#include "vm/vma.h"
+#include <string.h>
+#include <syscall-nr.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Orders areas by start address. */
+static bool
+vma_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct vm_area *a = rb_entry (a_, struct vm_area, elem);
+	const struct vm_area *b = rb_entry (b_, struct vm_area, elem);
+
+	return a->start < b->start;
+}
+
+/* Releases VMA itself; its pages must already be gone. */
+static void
+vma_free (struct vm_area *vma) {
+	file_close (vma->file);
+	free (vma);
+}
+
+static void
+vma_destructor (struct rb_elem *e, void *aux UNUSED) {
+	vma_free (rb_entry (e, struct vm_area, elem));
+}
+
+/* Initializes the area tree of SPT. */
+void
+vma_init (struct supplemental_page_table *spt) {
+	rb_init (&spt->vmas, vma_less, NULL);
+}
+
+/* Records PAGE_CNT pages starting at START as a new area of SPT.
+ * If FILE is non-null, the first READ_BYTES bytes of the area come from
+ * FILE at offset OFS and the area keeps its own reference to FILE.
+ * INIT, if non-null, fills each page on its first fault.
+ * Returns the new area, or NULL if it would overlap an existing one or
+ * memory is exhausted. */
+struct vm_area *
+vma_map (struct supplemental_page_table *spt, enum vm_type type,
+		void *start, size_t page_cnt, bool writable, struct file *file,
+		off_t ofs, size_t read_bytes, vm_initializer *init) {
+	void *end = start + page_cnt * PGSIZE;
+	struct vm_area *vma;
+
+	ASSERT (pg_ofs (start) == 0);
+	ASSERT (page_cnt > 0);
+	ASSERT (read_bytes <= page_cnt * PGSIZE);
+
+	if (vma_overlaps (spt, start, end))
+		return NULL;
+
+	vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return NULL;
+	vma->start = start;
+	vma->end = end;
+	vma->type = type;
+	vma->writable = writable;
+	vma->init = init;
+	vma->file = NULL;
+	vma->ofs = ofs;
+	vma->read_bytes = read_bytes;
+	vma->advice = MADV_NORMAL;
+	list_init (&vma->pages);
+	if (file != NULL) {
+		vma->file = file_reopen (file);
+		if (vma->file == NULL) {
+			free (vma);
+			return NULL;
+		}
+	}
+	rb_insert (&spt->vmas, &vma->elem);
+	return vma;
+}
+
+/* Destroys every materialized page of VMA, writing back what needs it,
+ * and then removes VMA from SPT. */
+void
+vma_unmap (struct supplemental_page_table *spt, struct vm_area *vma) {
+	while (!list_empty (&vma->pages)) {
+		struct page *page = list_entry (list_front (&vma->pages),
+				struct page, vma_elem);
+		spt_remove_page (spt, page);
+	}
+	rb_remove (&spt->vmas, &vma->elem);
+	vma_free (vma);
+}
+
+/* Returns the area of SPT that contains VA, or NULL. */
+struct vm_area *
+vma_find (struct supplemental_page_table *spt, const void *va) {
+	struct vm_area key = { .start = (void *) va };
+	struct rb_elem *e;
+
+	e = rb_floor (&spt->vmas, &key.elem);
+	if (e != NULL) {
+		struct vm_area *vma = rb_entry (e, struct vm_area, elem);
+		if (va < vma->end)
+			return vma;
+	}
+	return NULL;
+}
+
+/* Returns true if any area of SPT intersects [START, END). */
+bool
+vma_overlaps (struct supplemental_page_table *spt, const void *start,
+		const void *end) {
+	struct vm_area key = { .start = (void *) start };
+	struct rb_elem *e;
+
+	/* The area starting at or before START may run into the range... */
+	if (vma_find (spt, start) != NULL)
+		return true;
+
+	/* ...and so may the first one that starts after it. */
+	e = rb_upper_bound (&spt->vmas, &key.elem);
+	return e != NULL && rb_entry (e, struct vm_area, elem)->start < end;
+}
+
+/* Creates the supplemental page table entry for page VA of VMA in the
+ * current process and returns it, or NULL on allocation failure. */
+struct page *
+vma_populate (struct vm_area *vma, void *va) {
+	size_t page_ofs = va - vma->start;
+	vm_initializer *init = vma->init;
+	struct lazy_aux *aux = NULL;
+
+	ASSERT (pg_ofs (va) == 0);
+	ASSERT (va >= vma->start && va < vma->end);
+
+	if (vma->file != NULL && VM_TYPE (vma->type) == VM_ANON
+			&& vma->read_bytes <= page_ofs) {
+		/* Past the end of the file data (BSS): pure zeros, which need
+		 * no loader and may share the zero frame until written. */
+		init = NULL;
+	} else if (vma->file != NULL) {
+		size_t page_read_bytes = 0;
+
+		if (vma->read_bytes > page_ofs)
+			page_read_bytes = vma->read_bytes - page_ofs < PGSIZE
+				? vma->read_bytes - page_ofs : PGSIZE;
+
+		aux = malloc (sizeof *aux);
+		if (aux == NULL)
+			return NULL;
+		aux->file = vma->file;
+		aux->ofs = vma->ofs + page_ofs;
+		aux->read_bytes = page_read_bytes;
+		aux->zero_bytes = PGSIZE - page_read_bytes;
+	}
+
+	if (!vm_alloc_page_with_initializer (vma->type, va, vma->writable,
+				init, aux)) {
+		free (aux);
+		return NULL;
+	}
+	return spt_find_page (&thread_current ()->spt, va);
+}
+
+/* Copies the areas of SRC into DST for fork().  File mappings are not
+ * inherited.  Returns false if memory is exhausted. */
+bool
+vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct rb_elem *e;
+
+	for (e = rb_first (&src->vmas); e != NULL; e = rb_next (e)) {
+		struct vm_area *vma = rb_entry (e, struct vm_area, elem);
+		struct vm_area *copy;
+
+		if (VM_TYPE (vma->type) == VM_FILE)
+			continue;
+		copy = vma_map (dst, vma->type, vma->start,
+				(vma->end - vma->start) / PGSIZE, vma->writable,
+				vma->file, vma->ofs, vma->read_bytes, vma->init);
+		if (copy == NULL)
+			return false;
+		copy->advice = vma->advice;
+	}
+	return true;
+}
+
+/* Frees every area of SPT.  The pages must have been destroyed first. */
+void
+vma_kill (struct supplemental_page_table *spt) {
+	rb_clear (&spt->vmas, vma_destructor);
+}
@@ -0,0 +1,187 @@
+/* zswap.c: Compressed cache in front of the swap disk.
+
+   Writing a page to the swap disk takes eight programmed-I/O sector
+   transfers, so anon_swap_out() first offers each page to zswap.  A
+   page that is one 8-byte value repeated, most often all zeros, is
+   kept as that value alone.  Any other page is compressed with
+   lz_compress() and kept if it shrinks to at most half a page, in
+   objects of slab caches whose sizes go up in steps of
+   ZSWAP_CLASS_STEP bytes.  Pages that compress worse, or that arrive
+   while the caches already hold ZSWAP_POOL_FRACTION of the user pool,
+   go to the disk as before.
+
+   A page leaves zswap when it is swapped back in or destroyed. */
+
+#include "vm/zswap.h"
+#include <inttypes.h>
+#include <lz.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A stored page. */
+struct zswap_entry {
+	uint16_t len;               /* Compressed size; 0 if same-filled. */
+	uint8_t class;              /* Index of the cache it came from. */
+	uint64_t fill;              /* Value of a same-filled page. */
+	uint8_t data[];             /* Compressed contents. */
+};
+
+/* Size classes.  The largest holds two objects per slab, so every
+ * stored page takes at most half a page. */
+#define ZSWAP_CLASS_STEP 128
+#define ZSWAP_CLASS_CNT 15
+#define ZSWAP_MAX_LEN \
+	(ZSWAP_CLASS_CNT * ZSWAP_CLASS_STEP - sizeof (struct zswap_entry))
+
+/* Largest share of the user pool's size the caches may take, as a
+ * divisor. */
+#define ZSWAP_POOL_FRACTION 4
+
+static struct slab_cache classes[ZSWAP_CLASS_CNT];
+static char class_names[ZSWAP_CLASS_CNT][16];
+static size_t pool_max;             /* Most slab pages for the caches. */
+
+/* Protects the buffers and the statistics. */
+static struct lock zswap_lock;
+static uint8_t work[LZ_WORK_SIZE];
+static uint8_t buf[ZSWAP_MAX_LEN];
+
+/* Statistics. */
+static size_t stored_cnt;           /* Pages stored now. */
+static uint64_t same_cnt;           /* Same-filled pages stored. */
+static uint64_t comp_cnt;           /* Compressed pages stored. */
+static uint64_t comp_len;           /* Their total compressed size. */
+static uint64_t full_cnt;           /* Pages refused, pool full. */
+static uint64_t poor_cnt;           /* Pages refused, incompressible. */
+
+/* Initializes zswap.  Must be called before any user frame is
+ * allocated. */
+void
+zswap_init (void) {
+	size_t i;
+
+	for (i = 0; i < ZSWAP_CLASS_CNT; i++) {
+		snprintf (class_names[i], sizeof class_names[i], "zswap-%zu",
+				(i + 1) * ZSWAP_CLASS_STEP);
+		slab_cache_init (&classes[i], class_names[i],
+				(i + 1) * ZSWAP_CLASS_STEP, NULL);
+	}
+	pool_max = palloc_free_cnt (PAL_USER) / ZSWAP_POOL_FRACTION;
+	lock_init (&zswap_lock);
+}
+
+/* Returns the number of slab pages the caches hold. */
+static size_t
+pool_size (void) {
+	size_t i, cnt = 0;
+
+	for (i = 0; i < ZSWAP_CLASS_CNT; i++)
+		cnt += classes[i].slab_cnt;
+	return cnt;
+}
+
+/* Returns true if the page at KVA is one 8-byte value repeated, which
+ * is then stored in *FILL. */
+static bool
+same_filled (const void *kva, uint64_t *fill) {
+	const uint64_t *w = kva;
+	size_t i;
+
+	for (i = 1; i < PGSIZE / sizeof *w; i++)
+		if (w[i] != w[0])
+			return false;
+	*fill = w[0];
+	return true;
+}
+
+/* Allocates an entry with room for LEN bytes of data. */
+static struct zswap_entry *
+entry_alloc (size_t len) {
+	size_t class = (sizeof (struct zswap_entry) + len - 1) / ZSWAP_CLASS_STEP;
+	struct zswap_entry *e = slab_alloc (&classes[class]);
+
+	if (e != NULL) {
+		e->len = len;
+		e->class = class;
+	}
+	return e;
+}
+
+/* Stores a copy of the page at KVA.  Returns its entry, or a null
+ * pointer if the page should go to the disk instead. */
+struct zswap_entry *
+zswap_store (const void *kva) {
+	struct zswap_entry *e;
+	uint64_t fill;
+	size_t len;
+
+	if (same_filled (kva, &fill)) {
+		e = entry_alloc (0);
+		if (e == NULL)
+			return NULL;
+		e->fill = fill;
+		lock_acquire (&zswap_lock);
+		stored_cnt++;
+		same_cnt++;
+		lock_release (&zswap_lock);
+		return e;
+	}
+
+	lock_acquire (&zswap_lock);
+	if (pool_size () >= pool_max) {
+		full_cnt++;
+		lock_release (&zswap_lock);
+		return NULL;
+	}
+	len = lz_compress (kva, PGSIZE, buf, sizeof buf, work);
+	e = len != 0 ? entry_alloc (len) : NULL;
+	if (e == NULL) {
+		if (len == 0)
+			poor_cnt++;
+		lock_release (&zswap_lock);
+		return NULL;
+	}
+	memcpy (e->data, buf, len);
+	stored_cnt++;
+	comp_cnt++;
+	comp_len += len;
+	lock_release (&zswap_lock);
+	return e;
+}
+
+/* Copies the page stored in E to KVA and frees E. */
+void
+zswap_load (struct zswap_entry *e, void *kva) {
+	if (e->len == 0) {
+		uint64_t *w = kva;
+		size_t i;
+
+		for (i = 0; i < PGSIZE / sizeof *w; i++)
+			w[i] = e->fill;
+	} else if (!lz_decompress (e->data, e->len, kva, PGSIZE))
+		PANIC ("zswap: corrupt entry");
+	zswap_free (e);
+}
+
+/* Frees E. */
+void
+zswap_free (struct zswap_entry *e) {
+	lock_acquire (&zswap_lock);
+	stored_cnt--;
+	lock_release (&zswap_lock);
+	slab_free (&classes[e->class], e);
+}
+
+/* Prints compression statistics. */
+void
+zswap_print_stats (void) {
+	printf ("zswap: %"PRIu64" pages compressed to %"PRIu64"%%, "
+			"%"PRIu64" same-filled, %"PRIu64" refused full, "
+			"%"PRIu64" incompressible; %zu stored in %zu pages\n",
+			comp_cnt, comp_cnt != 0 ? comp_len * 100 / (comp_cnt * PGSIZE) : 0,
+			same_cnt, full_cnt, poor_cnt, stored_cnt, pool_size ());
+}